@@ -5,6 +5,28 @@
 #include <unistd.h>
 #include <time.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+#include <stddef.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include "tankgame.h"
 
 // terminal colors
 #define RED "\033[31m"
@@ -23,13 +45,84 @@
 #define MAX_PLAYER_NAME 20
 #define MAX_HIGH_SCORES 10  // Increased to show more high scores
 #define HIGH_SCORE_FILE "high_scores.txt"
-
-// Game board and objects
-char board[HEIGHT][WIDTH];
-int player_x, player_y;
-int player_lives;
-int score;
-char player_name[MAX_PLAYER_NAME];
+#define HIGH_SCORE_LOG_LIMIT (256 * 1024)  // compact the append-only score log past this size
+#define SHARED_SCORE_FILE "high_scores.shared"
+#define SHARED_SCORE_MAGIC 0x54425342
+#define SHARED_SYNC_SPINS 1000  // yields before a reader checks for a dead writer
+#define FRAME_BUFFER_SIZE 131072
+
+// Large map settings
+#define WORLD_WIDTH 240
+#define WORLD_HEIGHT 120
+#define MAX_WORLD_ENEMIES 96
+#define GRID_CELL 8  // side of one spatial index cell
+#define GRID_COLUMNS (WORLD_WIDTH / GRID_CELL)
+#define GRID_ROWS (WORLD_HEIGHT / GRID_CELL)
+
+// Spectator broadcast settings
+#define SPECTATE_SHM_NAME "/tank_battleship_spectate"
+#define SPECTATE_SLOTS 8
+#define SPECTATE_MAGIC 0x54424b53
+#define SPECTATE_CHECK_POLLS 50  // idle 10 ms polls between checks that the broadcaster is alive
+
+// Session recording settings
+#define RECORD_QUEUE_BYTES (4 * 1024 * 1024)
+
+// Telemetry settings
+#define METRIC_BUCKETS 10
+#define METRICS_TIMEOUT_MS 1000  // longest a scraper may stall the metrics thread
+
+// Snapshot settings
+#define SNAPSHOT_HISTORY 50  // 10 seconds at 5 ticks per second
+#define SAVE_GAME_FILE "saved_game.dat"
+#define SAVE_GAME_MAGIC 0x54425356
+
+// Fuzzer settings
+#define FUZZ_MAX_STEPS 100000
+#define FUZZ_NAMES 16  // leaderboard fuzzing draws names from a small pool
+
+// Per-game statistics log
+#define STATS_FILE "game_stats.col"
+#define STATS_MAGIC 0x54425354
+#define STATS_BLOCK_ROWS 4096
+#define STARTING_LIVES 3
+#define TICK_MS 200
+
+// Particle effects settings
+#define MAX_PARTICLES 512
+#define FRAME_BUDGET_US 4000  // work allowed per frame before low-priority effects are shed
+
+// Enemy movement scheduler settings
+#define ENEMY_MOVE_CHANCE 15   // an enemy steps down on 1 tick in 15 on average
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_FAR (2 * WHEEL_SLOTS)     // bucket for moves beyond the second level
+#define WHEEL_BUCKETS (WHEEL_FAR + 1)
+#define MOVE_DELAY_TABLE 512
+
+// Bitboard engine settings
+#define BITBOARD_MAX_WIDTH 32  // one row must fit in an unsigned int
+
+// Enemy AI settings
+#define FLOW_DANGER_COST 8  // extra cost for a cell a bullet is heading into
+
+// Player name search settings
+#define NAME_MATCHES 5      // suggestions under the name prompt
+#define SEARCH_MATCHES 10   // results on the player search page
+#define PREFIX_HEAP_SIZE 1024
+
+// Game server settings
+#define SERVER_MAX_WORKERS 4
+#define SERVER_MAX_EVENTS 256
+#define SERVER_STATUS_SECONDS 10
+#define SESSION_INPUT_QUEUE 8
+#define SESSION_OUTPUT_LIMIT (256 * 1024)  // unsent bytes before a client is dropped
+#define INVALID_INPUT_TICKS (3000 / TICK_MS)
+#define SCORE_QUEUE_SIZE 256  // finished games waiting for the score writer
+
+// Game board and objects. Everything one game touches while it runs is
+// thread-local, so each server worker can swap sessions in and out.
+_Thread_local char player_name[MAX_PLAYER_NAME];
 
 //Bullet structure
 typedef struct {
@@ -43,35 +136,411 @@ typedef struct {
     int x;
     int y;
     int active;
+    int next_move;                 // tick of this enemy's next step down
+    short wheel_bucket;            // timing wheel list it is in, -1 if none
+    short wheel_prev, wheel_next;  // neighbours in that list
 } Enemy;
 
 // High score node for linked list
 typedef struct ScoreNode {
     char name[MAX_PLAYER_NAME];
     int score;
+    int unsaved;  // new or better score not yet appended to the file
     struct ScoreNode* next;
 } ScoreNode;
 
 // Linked list head pointer
 ScoreNode* high_score_list = NULL;
 int num_high_scores = 0;
+long score_log_compacted_size = 0;  // size the score log was last compacted to
+
+// Background load of the high score file at startup
+pthread_t high_score_loader;
+int high_scores_loading = 0;
+_Atomic int high_scores_loaded = 0;  // set by the loader thread when it is done
+
+// Radix tree node in the player name index. The edge label is a run of
+// characters inside some player's stored name.
+typedef struct {
+    int label;          // offset of the label in prefix_text
+    unsigned char label_length;
+    unsigned char first;  // first label character, kept here so lookups skip the text
+    int first_child;    // children, newest first
+    int next_sibling;
+    int best;           // best score of any player in this subtree
+    int player;         // player whose name ends here, -1 if none
+} PrefixNode;
+
+// One player in the name index
+typedef struct {
+    int name;   // offset of the name in prefix_text
+    int score;  // best score
+} PrefixPlayer;
+
+// Work list entry for a best-first prefix search
+typedef struct {
+    int key;
+    int index;
+    int is_player;
+} PrefixHeapEntry;
+
+PrefixNode* prefix_nodes = NULL;
+int prefix_node_count = 0, prefix_node_capacity = 0;
+PrefixPlayer* prefix_players = NULL;
+int prefix_player_count = 0, prefix_player_capacity = 0;
+char* prefix_text = NULL;  // every indexed name, NUL-terminated, back to back
+size_t prefix_text_length = 0, prefix_text_capacity = 0;
+
+// One entry in the shared leaderboard file
+typedef struct {
+    char name[MAX_PLAYER_NAME];
+    int score;
+} SharedScore;
+
+// Leaderboard mapped by every game on the host. Writers take the robust
+// process-shared lock; readers never lock and instead retry if the
+// sequence was odd or changed while they copied the entries.
+typedef struct {
+    unsigned int magic;
+    pthread_mutex_t lock;
+    _Atomic unsigned int sequence;
+    int count;
+    SharedScore entries[MAX_HIGH_SCORES];
+} SharedBoard;
+
+SharedBoard* shared_board = NULL;
+unsigned int shared_board_seen = 0;  // sequence last copied into the linked list
+int shared_board_seeding = 0;  // this process created the board; the loader fills it
+
+// Everything the simulation needs lives in one flat struct so a
+// snapshot, rewind or save is a single memcpy with no pointers to fix up
+typedef struct {
+    int world_width, world_height;
+    int enemy_limit;
+    int player_x, player_y;
+    int player_lives;
+    int score;
+    Bullet bullets[MAX_BULLETS];
+    Enemy enemies[MAX_WORLD_ENEMIES];
+    unsigned int rng;
+    short wheel_heads[WHEEL_BUCKETS];  // enemy movement timing wheel
+    int ticks;
+    int shots_fired;
+    int hits;
+} GameState;
 
 // Game objects
-Bullet bullets[MAX_BULLETS];
-Enemy enemies[MAX_ENEMIES];
+_Thread_local GameState game;
+
+// Rewind history for practice mode
+GameState snapshot_ring[SNAPSHOT_HISTORY];
+int snapshot_head = 0;
+int snapshot_count = 0;
+int practice_mode = 0;
+int large_map_mode = 0;
+int quiet_mode = 0;  // set by headless tools: no messages or pauses from game code
+
+// move_delay_threshold[k] is P(next move is more than k ticks away)
+// scaled to 2^31, i.e. (1 - 1/ENEMY_MOVE_CHANCE)^k
+unsigned int move_delay_threshold[MOVE_DELAY_TABLE];
+pthread_once_t move_delays_once = PTHREAD_ONCE_INIT;  // batch and server threads share the table
+
+// Visible window onto the world. The camera follows the player and only
+// the cells and entities inside it are drawn, so a frame costs the same
+// whatever the size of the world.
+_Thread_local char view[WORLD_HEIGHT][WORLD_WIDTH];
+_Thread_local int view_width = WIDTH, view_height = HEIGHT;
+_Thread_local int camera_x = 0, camera_y = 0;
+volatile sig_atomic_t terminal_resized = 1;
+
+// Spatial index: entities bucketed by GRID_CELL x GRID_CELL world cell.
+// Ids below MAX_BULLETS are bullets, the rest are enemies.
+#define GRID_ENTITIES (MAX_BULLETS + MAX_WORLD_ENEMIES)
+_Thread_local short grid_head[GRID_ROWS][GRID_COLUMNS];
+_Thread_local short grid_next[GRID_ENTITIES];
+_Thread_local short grid_cell_of[GRID_ENTITIES];
+
+// Bitboard engine: one 32-bit word per row, bit x set when column x holds
+// an enemy. enemy_cell_count keeps the exact number per cell so a bit is
+// only cleared when the last enemy leaves. The bullets at the start of the
+// tick and the cells enemies stepped straight down from let collisions
+// catch a bullet and an enemy that swapped cells.
+int bitboard_mode = 0;
+_Thread_local int bitboard_enabled = 0;  // bitboard_mode and the world is narrow enough
+_Thread_local unsigned int enemy_rows[HEIGHT];
+_Thread_local unsigned int enemy_down_rows[HEIGHT];  // bit x of row y: an enemy moved (x, y) -> (x, y + 1)
+_Thread_local unsigned int bullet_from_rows[HEIGHT];
+_Thread_local unsigned char enemy_cell_count[HEIGHT][BITBOARD_MAX_WIDTH];
+
+// Shared flow field for the enemy AI. flow_next_x[y][x] is the column an
+// enemy at (x, y) should step into on row y + 1. Both tables are cached and
+// only the cells a player or bullet change reaches are recomputed.
+int ai_mode = 0;
+_Thread_local int flow_distance[WORLD_HEIGHT][WORLD_WIDTH];
+_Thread_local unsigned char flow_next_x[WORLD_HEIGHT][WORLD_WIDTH];
+_Thread_local int flow_player_x = -1;
+_Thread_local int flow_world_width = 0, flow_world_height = 0;
+_Thread_local int flow_lane_bottom[WORLD_WIDTH];
+
+// Particle pool, one array per field so the update pass streams through
+// memory. Live particles are packed at the front; a dead one is replaced
+// by the last live particle. Positions and velocities are in 1/16 cells.
+_Thread_local int particle_x[MAX_PARTICLES];
+_Thread_local int particle_y[MAX_PARTICLES];
+_Thread_local signed char particle_vx[MAX_PARTICLES];
+_Thread_local signed char particle_vy[MAX_PARTICLES];
+_Thread_local unsigned char particle_age[MAX_PARTICLES];
+_Thread_local unsigned char particle_life[MAX_PARTICLES];
+_Thread_local char particle_glyph[MAX_PARTICLES];
+_Thread_local unsigned char particle_low_priority[MAX_PARTICLES];
+_Thread_local int particle_count = 0;
+_Thread_local int particles_enabled = 1;
+_Thread_local unsigned int particle_rng = 2463534242u;  // kept apart from game.rng so effects never change the game
+
+// Time spent on each part of the last frame, in microseconds
+typedef struct {
+    long long update_us;
+    long long particles_us;
+    long long render_us;
+    long long total_us;
+    int over_budget;
+} FrameStats;
+
+_Thread_local FrameStats frame_stats;
+_Thread_local int show_frame_stats = 0;
+
+// Latency histogram for the metrics endpoint. The game thread only does
+// relaxed atomic adds; the server thread sums buckets when scraped.
+typedef struct {
+    const char* name;
+    const char* help;
+    _Atomic unsigned long buckets[METRIC_BUCKETS + 1];  // last one is +Inf
+    _Atomic unsigned long count;
+    _Atomic unsigned long long sum_us;
+} Histogram;
+
+// Bucket upper bounds in microseconds
+const long long metric_bounds_us[METRIC_BUCKETS] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000, 250000
+};
+
+Histogram frame_histogram = { .name = "tank_frame_seconds", .help = "Work per frame (simulation, effects and drawing)" };
+Histogram tick_histogram = { .name = "tank_tick_seconds", .help = "Simulation time per tick" };
+Histogram input_histogram = { .name = "tank_input_to_render_seconds", .help = "Time from reading a key to the frame that shows it" };
+Histogram save_histogram = { .name = "tank_save_high_scores_seconds", .help = "Duration of save_high_scores()" };
+Histogram load_histogram = { .name = "tank_load_high_scores_seconds", .help = "Duration of load_high_scores()" };
+
+// Gauges published by the game thread once per frame
+_Atomic int metric_enemies = 0;
+_Atomic int metric_bullets = 0;
+_Atomic int metric_particles = 0;
+_Atomic int metric_high_scores = 0;
+_Atomic unsigned long metric_frames = 0;
+_Atomic unsigned long metric_games = 0;
+_Atomic long long time_to_first_frame_us = 0;  // from the start of main() to the first screen
+long long process_start_us = 0;
+int metrics_fd = -1;
+pthread_t metrics_thread;
+
+// Statistics are stored column by column in fixed-size blocks. Each block
+// header carries min/max values so queries can skip blocks without
+// touching their columns, and appending a game never rewrites old rows.
+typedef struct {
+    unsigned int magic;
+    int rows;
+    long long min_time, max_time;
+    int min_score, max_score;
+    int min_length_ms, max_length_ms;
+} StatsBlockHeader;
+
+typedef struct {
+    StatsBlockHeader header;
+    char names[STATS_BLOCK_ROWS][MAX_PLAYER_NAME];
+    long long times[STATS_BLOCK_ROWS];
+    int scores[STATS_BLOCK_ROWS];
+    int lengths_ms[STATS_BLOCK_ROWS];
+    int shots_fired[STATS_BLOCK_ROWS];
+    int hits[STATS_BLOCK_ROWS];
+    int lives_lost[STATS_BLOCK_ROWS];
+} StatsBlock;
+
+// A game that has just ended, as the stats log and leaderboard need it
+typedef struct {
+    char name[MAX_PLAYER_NAME];
+    int score;
+    int ticks;
+    int shots_fired;
+    int hits;
+    int player_lives;
+} FinishedGame;
+
+// Running totals for one player while answering a stats query
+typedef struct {
+    char name[MAX_PLAYER_NAME];
+    int games;
+    long long total_score;
+    long long shots_fired;
+    long long hits;
+    long long lives_lost;
+    long long length_ms;
+    int* scores;
+    int scores_capacity;
+} PlayerStats;
+
+// One player connected to the game server. The worker thread that
+// accepted the connection owns it; its game is copied into the worker's
+// thread-local state for each key or tick and back out afterwards.
+enum {
+    SESSION_MENU,
+    SESSION_NAME,
+    SESSION_CONTROLS,
+    SESSION_PLAYING,
+    SESSION_GAME_OVER,
+    SESSION_GAME_OVER_MENU,
+    SESSION_SCORES,
+    SESSION_SEARCH,
+    SESSION_ABOUT,
+    SESSION_INVALID,  // invalid input warning, then back to return_state
+    SESSION_CLOSED
+};
+
+// Telnet option negotiation is skipped over byte by byte
+enum { TELNET_DATA, TELNET_COMMAND, TELNET_OPTION, TELNET_SUBNEGOTIATION, TELNET_SUBNEGOTIATION_IAC };
+
+typedef struct Session {
+    int fd;
+    int state;
+    int return_state;  // screen to go back to from high scores or a warning
+    int wait_ticks;    // ticks left on the invalid input warning
+    GameState game;
+    char name[MAX_PLAYER_NAME];
+    int name_length;
+    char query[MAX_PLAYER_NAME];  // player search prefix
+    int query_length;
+    int show_frame_stats;
+    unsigned char input[SESSION_INPUT_QUEUE];  // keys for the next ticks, one per tick
+    int input_count;
+    int telnet_state;
+    unsigned char last_byte;
+    char* output;  // bytes the socket has not taken yet
+    int output_length, output_capacity;
+    struct Session* prev;
+    struct Session* next;
+} Session;
+
+// Worker thread with its own epoll set and sessions
+typedef struct {
+    pthread_t thread;
+    int epoll_fd;
+    Session* sessions;
+} ServerWorker;
+
+int server_mode = 0;
+int server_listen_fd = -1;
+int server_worker_count = 0;
+ServerWorker server_workers[SERVER_MAX_WORKERS];
+_Atomic int server_sessions = 0;
+_Atomic long server_output_bytes = 0;  // output buffer capacity across sessions
+_Atomic unsigned long server_frames_dropped = 0;
+_Thread_local Session* current_session = NULL;  // where screens and frames go, NULL for the terminal
+
+// Finished server games waiting for the score writer thread, so workers
+// never touch the disk or wait for the leaderboard load. A full queue
+// drops the game rather than stalling the tick.
+FinishedGame score_queue[SCORE_QUEUE_SIZE];
+int score_queue_head = 0;
+int score_queue_count = 0;
+pthread_mutex_t score_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t score_queue_ready = PTHREAD_COND_INITIALIZER;
+_Atomic unsigned long score_queue_dropped = 0;
+pthread_t score_writer;
+
+// The linked list is shared by every session in the server
+pthread_mutex_t leaderboard_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Terminal settings
 struct termios original_terminal;
 
+// Frame buffer the renderer draws into before writing it out in one go
+_Thread_local char frame_buffer[FRAME_BUFFER_SIZE];
+_Thread_local int frame_length = 0;
+
+// One frame slot in the spectator ring (sequence is odd while being written)
+typedef struct {
+    _Atomic unsigned long sequence;
+    int length;
+    char data[FRAME_BUFFER_SIZE];
+} SpectateSlot;
+
+// Shared memory ring: a single game writes, any number of spectators read
+typedef struct {
+    unsigned int magic;
+    int slot_count;
+    _Atomic int live;
+    _Atomic unsigned long frames_published;
+    SpectateSlot slots[SPECTATE_SLOTS];
+} SpectateRing;
+
+SpectateRing* spectate_ring = NULL;
+int spectate_fd = -1;  // kept open with an exclusive flock while we broadcast
+
+// Frames waiting for the recorder thread. The game thread appends
+// (header, bytes) records to this byte ring and the recorder consumes
+// them; head and tail only ever grow, and a full queue drops the frame
+// rather than making the game wait.
+typedef struct {
+    long long time_us;
+    int length;
+    int padding;
+} RecordHeader;
+
+unsigned char record_queue[RECORD_QUEUE_BYTES];
+_Atomic unsigned long record_head = 0;
+_Atomic unsigned long record_tail = 0;
+_Atomic int record_stop = 0;
+_Atomic int record_failed = 0;   // the writer hit an error (gzip gone) and quit
+_Atomic unsigned long record_dropped = 0;
+int recording = 0;
+long long record_start_us = 0;
+int record_columns = 80, record_rows = 24;
+FILE* record_file = NULL;
+pid_t record_compressor = -1;
+pthread_t record_thread;
+
+// Games driven through the library interface in tankgame.h
+struct TankBatch {
+    int count;
+    int options;
+    unsigned int rng;  // seeds for new games
+    size_t observation_size;
+    GameState* games;
+    unsigned char* ended;  // game over on the last step, restart on the next
+};
+
+// The mode flags are process-wide, so every live batch shares one set
+pthread_mutex_t tank_batches_lock = PTHREAD_MUTEX_INITIALIZER;
+int tank_batches_live = 0;
+int tank_batches_options = 0;
+
 // Function prototypes
 void setup_terminal();
 void reset_terminal();
 void clear_screen();
 void initialize_game();
+void initialize_game_with_seed(unsigned int seed);
 void show_welcome();
+void draw_main_menu();
+void draw_invalid_input();
+void draw_controls();
+void draw_game_over();
+void draw_game_over_menu();
+void draw_high_scores();
+void draw_about_developers();
 void get_player_name();
 void play_game();
 void update_game();
+void build_view(int* view_w, int* view_h);
+void compose_frame(int* view_w, int* view_h);
 void render_game();
 void move_player(char direction);
 void fire_bullet();
@@ -80,6 +549,20 @@ void check_collisions();
 void show_game_over();
 void show_game_over_menu();
 void load_high_scores();
+void load_player_names();
+void start_loading_high_scores();
+void wait_for_high_scores();
+int high_scores_ready();
+int high_scores_available();
+
+// Player name index functions
+void prefix_index_clear();
+void prefix_index_add(const char* name, int name_length, int score);
+int prefix_index_search(const char* prefix, int limit, const char** names, int* scores);
+void draw_name_prompt(const char* typed);
+void complete_player_name(char* typed, int* length);
+void draw_player_search(const char* query);
+void search_players();
 void save_high_scores();
 void add_high_score(const char* name, int score);
 void display_high_scores();
@@ -87,12 +570,94 @@ int is_high_score(int score);
 void display_about_developers();
 int min(int a, int b); // Added min function prototype
 
+// Snapshot functions
+unsigned int game_rand();
+void take_snapshot();
+int rewind_snapshot();
+int save_game();
+int load_game();
+
+// Enemy scheduler functions
+int draw_move_delay();
+void schedule_enemy(int i);
+void unschedule_enemy(int i);
+void move_due_enemies();
+
+// Bitboard engine functions
+void bitboard_rebuild();
+void bitboard_place(int x, int y);
+void bitboard_remove(int x, int y);
+void bitboard_move(int from_x, int from_y, int to_x, int to_y);
+void bitboard_begin_tick();
+void bitboard_bottom_row();
+void bitboard_check_collisions();
+int run_bench(int argc, char* argv[]);
+
+// Enemy AI functions
+void update_flow_field();
+
+// World and viewport functions
+void index_entities();
+void update_view_size();
+void handle_resize(int signal_number);
+
+// Particle functions
+long long now_us();
+void spawn_particle(int x, int y, int vx, int vy, int life, char glyph, int low_priority);
+void spawn_explosion(int x, int y);
+void spawn_muzzle_flash(int x, int y);
+void update_particles();
+void draw_particles(int view_w, int view_h);
+
+// Telemetry functions
+void observe(Histogram* histogram, long long microseconds);
+void publish_gauges();
+int parse_port(const char* text);
+int start_metrics(const char* address);
+void* metrics_main(void* unused);
+
+// Fuzzer functions
+int run_fuzz(int argc, char* argv[]);
+
+// Statistics functions
+void describe_finished_game(FinishedGame* finished);
+void record_game_stats(const FinishedGame* finished);
+int run_stats(int argc, char* argv[]);
+
+// Frame buffer and spectator functions
+void frame_printf(const char* format, ...);
+void present_frame();
+void present_screen();
+void restore_game_state(const GameState* state);
+void session_send(Session* session, const char* data, int length, int droppable);
+int open_broadcast();
+void close_broadcast();
+void publish_frame(const char* data, int length);
+int run_spectator();
+
+// Game server functions
+int run_server(int port);
+void* server_worker_main(void* arg);
+void queue_finished_game(const FinishedGame* finished);
+void* score_writer_main(void* unused);
+
+// Recording functions
+int start_recording(const char* path);
+void stop_recording();
+void record_frame(const char* data, int length);
+void* recorder_main(void* unused);
+
 // Linked list functions
 ScoreNode* create_score_node(const char* name, int score);
 void free_score_list();
 ScoreNode* binary_search_score(int target_score);
 ScoreNode* find_player_entry(const char* name);
 
+// Shared leaderboard functions
+int open_shared_board();
+int shared_board_add(const char* name, int score);
+void shared_board_sync();
+
 // Set up terminal for game input
 void setup_terminal() {
     tcgetattr(STDIN_FILENO, &original_terminal);
@@ -115,42 +680,107 @@ void clear_screen() {
 
 // Initialize the game state
 void initialize_game() {
+    initialize_game_with_seed(((unsigned int)rand() << 1) | 1);
+}
+
+// Initialize the game state with a fixed random seed (same seed, same game)
+void initialize_game_with_seed(unsigned int seed) {
+    // Size the world
+    if (large_map_mode) {
+        game.world_width = WORLD_WIDTH;
+        game.world_height = WORLD_HEIGHT;
+        game.enemy_limit = MAX_WORLD_ENEMIES;
+    } else {
+        game.world_width = WIDTH;
+        game.world_height = HEIGHT;
+        game.enemy_limit = MAX_ENEMIES;
+    }
+
     // Set up the player
-    player_x = WIDTH / 2;
-    player_y = HEIGHT - 2;
-    player_lives = 3;  // Back to 3 lives as requested
-    score = 0;
+    game.player_x = game.world_width / 2;
+    game.player_y = game.world_height - 2;
+    game.player_lives = STARTING_LIVES;  // Back to 3 lives as requested
+    game.score = 0;
+    game.rng = seed ? seed : 1;  // xorshift must not start at zero
+    game.ticks = 0;
+    game.shots_fired = 0;
+    game.hits = 0;
+
+    // No effects left over from the last game
+    particle_count = 0;
+
+    // Start with an empty rewind history
+    snapshot_head = 0;
+    snapshot_count = 0;
 
     // Clear bullets and enemies
     for (int i = 0; i < MAX_BULLETS; i++) {
-        bullets[i].active = 0;
+        game.bullets[i].active = 0;
     }
 
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        enemies[i].active = 0;
+    for (int i = 0; i < MAX_WORLD_ENEMIES; i++) {
+        game.enemies[i].active = 0;
+        game.enemies[i].wheel_bucket = -1;
     }
 
-    // Create all enemies (MAX_ENEMIES)
-    for (int i = 0; i < MAX_ENEMIES; i++) {
+    // Nobody is scheduled to move yet
+    for (int i = 0; i < WHEEL_BUCKETS; i++) {
+        game.wheel_heads[i] = -1;
+    }
+
+    // Empty bitboards for the new board
+    bitboard_rebuild();
+
+    // Create all enemies (enemy_limit)
+    for (int i = 0; i < game.enemy_limit; i++) {
         create_enemy();
     }
+
+    // Start from an empty spatial index
+    for (int row = 0; row < GRID_ROWS; row++) {
+        for (int column = 0; column < GRID_COLUMNS; column++) {
+            grid_head[row][column] = -1;
+        }
+    }
+    for (int i = 0; i < GRID_ENTITIES; i++) {
+        grid_cell_of[i] = -1;
+    }
+    index_entities();
 }
 
-// Show welcome menu and get player choice
-void show_welcome() {
-    clear_screen();
-    printf("\n\n");
-    printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
-    printf("    %s║       TANK BATTLESHIP         ║%s\n", YELLOW, RESET);
-    printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
+// Draw the main menu into the frame buffer
+void draw_main_menu() {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n");
+    frame_printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
+    frame_printf("    %s║       TANK BATTLESHIP         ║%s\n", YELLOW, RESET);
+    frame_printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
+
+    frame_printf("    %sMAIN MENU:%s\n\n", GREEN, RESET);
+    frame_printf("    %s1.%s Start Game\n", CYAN, RESET);
+    frame_printf("    %s2.%s View High Scores\n", CYAN, RESET);
+    frame_printf("    %s3.%s About Developers\n", CYAN, RESET);
+    frame_printf("    %s4.%s Quit\n\n", CYAN, RESET);
+
+    frame_printf("    %sEnter your choice (1-4): %s", MAGENTA, RESET);
+}
 
-    printf("    %sMAIN MENU:%s\n\n", GREEN, RESET);
-    printf("    %s1.%s Start Game\n", CYAN, RESET);
-    printf("    %s2.%s View High Scores\n", CYAN, RESET);
-    printf("    %s3.%s About Developers\n", CYAN, RESET);
-    printf("    %s4.%s Quit\n\n", CYAN, RESET);
+// Draw the invalid input warning shown before a menu comes back
+void draw_invalid_input() {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n");
+    frame_printf("    %s╔═══════════════════════════════╗%s\n", RED, RESET);
+    frame_printf("    %s║         INVALID INPUT         ║%s\n", RED, RESET);
+    frame_printf("    %s╚═══════════════════════════════╝%s\n\n", RED, RESET);
+    frame_printf("    %sInvalid Input dalta h Gadhee common sense use krleeee....!!!%s\n\n", MAGENTA, RESET);
+}
 
-    printf("    %sEnter your choice (1-4): %s", MAGENTA, RESET);
+// Show welcome menu and get player choice
+void show_welcome() {
+    draw_main_menu();
+    present_screen();
 
     char choice;
     int valid_input = 0;
@@ -161,30 +791,15 @@ void show_welcome() {
                 valid_input = 1;
             } else {
                 // Show invalid input message
-                clear_screen();
-                printf("\n\n");
-                printf("    %s╔═══════════════════════════════╗%s\n", RED, RESET);
-                printf("    %s║         INVALID INPUT         ║%s\n", RED, RESET);
-                printf("    %s╚═══════════════════════════════╝%s\n\n", RED, RESET);
-                printf("    %sInvalid Input dalta h Gadhee common sense use krleeee....!!!%s\n\n", MAGENTA, RESET);
+                draw_invalid_input();
+                present_screen();
 
                 // Wait for 3 seconds
                 sleep(3);
 
                 // welcome menu
-                clear_screen();
-                printf("\n\n");
-                printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
-                printf("    %s║     TANK BATTLESHIP           ║%s\n", YELLOW, RESET);
-                printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
-
-                printf("    %sMAIN MENU:%s\n\n", GREEN, RESET);
-                printf("    %s1.%s Start Game\n", CYAN, RESET);
-                printf("    %s2.%s View High Scores\n", CYAN, RESET);
-                printf("    %s3.%s About Developers\n", CYAN, RESET);
-                printf("    %s4.%s Quit\n\n", CYAN, RESET);
-
-                printf("    %sEnter your choice (1-4): %s", MAGENTA, RESET);
+                draw_main_menu();
+                present_screen();
             }
         }
         usleep(100000); // Wait a bit before checking again
@@ -212,43 +827,88 @@ void show_welcome() {
     }
 }
 
-// Get player name
+// Get player name. Typing shows matching players from the leaderboard
+// and Tab takes the best of them, so returning players keep one entry.
 void get_player_name() {
-    clear_screen();
-    reset_terminal(); // Temporarily reset terminal to normal mode for name input
+    int length = 0;
+    player_name[0] = '\0';
     tcflush(STDIN_FILENO, TCIFLUSH);
-    
-    printf("\n\n    %sEnter your name: %s", YELLOW, RESET);
-    fgets(player_name, MAX_PLAYER_NAME, stdin);
-    player_name[strcspn(player_name, "\n")] = 0;
+
+    draw_name_prompt(player_name);
+    present_screen();
+    int loading = !high_scores_ready();
+
+    while (1) {
+        char c;
+        if (read(STDIN_FILENO, &c, 1) <= 0) {
+            // Show the matches as soon as the player names have loaded
+            if (loading && high_scores_ready()) {
+                loading = 0;
+                draw_name_prompt(player_name);
+                present_screen();
+            }
+            usleep(10000);
+            continue;
+        }
+
+        if (c == '\n' || c == '\r') {
+            break;
+        } else if (c == '\t') {
+            complete_player_name(player_name, &length);
+        } else if ((c == 127 || c == '\b') && length > 0) {
+            player_name[--length] = '\0';
+        } else if (isgraph((unsigned char)c) && length < MAX_PLAYER_NAME - 1) {
+            // No spaces: the score file separates name and score with one
+            player_name[length++] = c;
+            player_name[length] = '\0';
+        } else {
+            continue;
+        }
+
+        draw_name_prompt(player_name);
+        present_screen();
+    }
 
     // If empty name, use "Player"
-    if (strlen(player_name) == 0) {
+    if (length == 0) {
         strcpy(player_name, "Player");
     }
+}
 
-    setup_terminal(); 
+// Draw the controls page shown before every game
+void draw_controls() {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n");
+    frame_printf("    %sWelcome, %s!%s\n", GREEN, player_name, RESET);
+    frame_printf("    %sThis is the game instructions page..!!%s\n\n", MAGENTA, RESET);
+    frame_printf("    %s===== GAME CONTROLS =====%s\n\n", YELLOW, RESET);
+    frame_printf("    %sA%s - Move Left\n", GREEN, RESET);
+    frame_printf("    %sD%s - Move Right\n", GREEN, RESET);
+    frame_printf("    %sF%s - Fire\n", GREEN, RESET);
+    if (practice_mode) {
+        // Saving, loading and rewinding would let a ranked game retry its
+        // mistakes, so only practice games have them
+        frame_printf("    %sS%s - Save Game (practice mode)\n", GREEN, RESET);
+        frame_printf("    %sL%s - Load Saved Game (practice mode)\n", GREEN, RESET);
+        frame_printf("    %sR%s - Rewind (practice mode)\n", GREEN, RESET);
+    }
+    frame_printf("    %sT%s - Show Frame Timing\n", GREEN, RESET);
+    frame_printf("    %sM%s - Return to Main Menu\n", GREEN, RESET);
+    frame_printf("    %sQ%s - Quit Game\n\n", GREEN, RESET);
+    frame_printf("    %sGame Rules:%s\n", CYAN, RESET);
+    frame_printf("    - You have 3 lives\n");
+    frame_printf("    - Destroy enemy tanks to score points\n");
+    frame_printf("    - Lose a life when enemies reach the bottom\n");
+    frame_printf("    - Game ends when you lose all lives\n\n");
+    frame_printf("    %sGood Luck...!!%s\n\n", MAGENTA, RESET);
+    frame_printf("    %sPress any key to start the game...%s\n", YELLOW, RESET);
 }
 
 // game controls
 void show_controls() {
-    clear_screen();
-    printf("\n\n");
-    printf("    %sWelcome, %s!%s\n", GREEN, player_name, RESET);
-    printf("    %sThis is the game instructions page..!!%s\n\n", MAGENTA, RESET);
-    printf("    %s===== GAME CONTROLS =====%s\n\n", YELLOW, RESET);
-    printf("    %sA%s - Move Left\n", GREEN, RESET);
-    printf("    %sD%s - Move Right\n", GREEN, RESET);
-    printf("    %sF%s - Fire\n", GREEN, RESET);
-    printf("    %sM%s - Return to Main Menu\n", GREEN, RESET);
-    printf("    %sQ%s - Quit Game\n\n", GREEN, RESET);
-    printf("    %sGame Rules:%s\n", CYAN, RESET);
-    printf("    - You have 3 lives\n");
-    printf("    - Destroy enemy tanks to score points\n");
-    printf("    - Lose a life when enemies reach the bottom\n");
-    printf("    - Game ends when you lose all lives\n\n");
-    printf("    %sGood Luck...!!%s\n\n", MAGENTA, RESET);
-    printf("    %sPress any key to start the game...%s\n", YELLOW, RESET);
+    draw_controls();
+    present_screen();
 
     // Wait for key press
     char c;
@@ -261,20 +921,40 @@ void show_controls() {
 void play_game() {
     show_controls();
     initialize_game();
+    atomic_fetch_add_explicit(&metric_games, 1, memory_order_relaxed);
     int quit = 0;
 
     while (!quit) {
         // Check for input
         char c;
+        long long input_at = 0;
         if (read(STDIN_FILENO, &c, 1) > 0) {
+            input_at = now_us();
             c = tolower(c);
-            if (c == 'a' || c == 'd') {
+            if (c == 'a' || c == 'd' || (large_map_mode && (c == 'w' || c == 'x'))) {
                 move_player(c);
             } else if (c == 'f') {
                 fire_bullet();
+            } else if (c == 'r' && practice_mode) {
+                // Scrub backward one tick and hold there while R is pressed
+                rewind_snapshot();
+                index_entities();
+                bitboard_rebuild();
+                render_game();
+                usleep(200000);
+                continue;
+            } else if (c == 's' && practice_mode) {
+                save_game();
+            } else if (c == 'l' && practice_mode) {
+                if (load_game()) {
+                    index_entities();
+                    bitboard_rebuild();
+                }
             } else if (c == 'm') {
                 show_welcome();
                 return;
+            } else if (c == 't') {
+                show_frame_stats = !show_frame_stats;
             } else if (c == 'q') {
                 quit = 1;
             } else if (c != '\n' && c != '\r') {
@@ -285,11 +965,29 @@ void play_game() {
             }
         }
 
+        long long frame_start = now_us();
+        if (practice_mode) {
+            take_snapshot();
+        }
         update_game();
+        frame_stats.update_us = now_us() - frame_start;
+
         render_game();
 
+        // Shed low-priority effects next frame if this one ran long
+        long long frame_end = now_us();
+        frame_stats.total_us = frame_end - frame_start;
+        frame_stats.over_budget = frame_stats.total_us > FRAME_BUDGET_US;
+
+        observe(&tick_histogram, frame_stats.update_us);
+        observe(&frame_histogram, frame_stats.total_us);
+        if (input_at != 0) {
+            observe(&input_histogram, frame_end - input_at);
+        }
+        publish_gauges();
+
         // Check if game is over
-        if (player_lives <= 0) {
+        if (game.player_lives <= 0) {
             show_game_over();
             break;
         }
@@ -300,130 +998,225 @@ void play_game() {
 
 // Update game
 void update_game() {
+    game.ticks++;
+
+    if (bitboard_enabled) {
+        bitboard_begin_tick();
+    }
+
     // Move bullets up
     for (int i = 0; i < MAX_BULLETS; i++) {
-        if (bullets[i].active) {
-            bullets[i].y--;
-            if (bullets[i].y <= 0) {
-                bullets[i].active = 0;
+        if (game.bullets[i].active) {
+            game.bullets[i].y--;
+            if (game.bullets[i].y <= 0) {
+                game.bullets[i].active = 0;
             }
         }
     }
 
-    // Move enemies down
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        if (enemies[i].active) {
-            if (rand() % 15 == 0) {
-                enemies[i].y++;
-
-                // Check if enemy reached bottom
-                if (enemies[i].y >= HEIGHT - 1) {
-                    enemies[i].active = 0;
-                    player_lives--;
-                    // Create a new enemy to replace the one that reached the bottom
-                    create_enemy();
-                }
-            }
-        }
+    // Let the AI see where the bullets are now
+    if (ai_mode) {
+        update_flow_field();
     }
 
+    // Move the enemies whose turn has come
+    move_due_enemies();
+
     // Create new enemy if existing eliminated
     int active_count = 0;
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        if (enemies[i].active) {
+    for (int i = 0; i < game.enemy_limit; i++) {
+        if (game.enemies[i].active) {
             active_count++;
         }
     }
 
     // Keep always max enemies
-    while (active_count < MAX_ENEMIES) {
+    while (active_count < game.enemy_limit) {
         create_enemy();
         active_count++;
     }
 
-    check_collisions();
+    if (bitboard_enabled) {
+        bitboard_check_collisions();
+    } else {
+        check_collisions();
+    }
+    index_entities();
 }
 
-// Render the game to the screen
-void render_game() {
-    clear_screen();
-
-    // Clear the board
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            if (y == 0 || y == HEIGHT - 1 || x == 0 || x == WIDTH - 1) {
-                board[y][x] = '#';
+// Fill view with what the camera sees: walls, bullets, enemies, effects
+// and the player. Returns the size of the visible part.
+void build_view(int* view_w_out, int* view_h_out) {
+    // Keep the player centred, but never show anything past the world edge
+    int view_w = min(view_width, game.world_width);
+    int view_h = min(view_height, game.world_height);
+    camera_x = game.player_x - view_w / 2;
+    camera_y = game.player_y - view_h / 2;
+    if (camera_x > game.world_width - view_w) camera_x = game.world_width - view_w;
+    if (camera_y > game.world_height - view_h) camera_y = game.world_height - view_h;
+    if (camera_x < 0) camera_x = 0;
+    if (camera_y < 0) camera_y = 0;
+
+    // Clear the visible part of the board
+    for (int y = 0; y < view_h; y++) {
+        int world_y = camera_y + y;
+        for (int x = 0; x < view_w; x++) {
+            int world_x = camera_x + x;
+            if (world_y == 0 || world_y == game.world_height - 1 ||
+                world_x == 0 || world_x == game.world_width - 1) {
+                view[y][x] = '#';
             } else {
-                board[y][x] = ' ';
+                view[y][x] = ' ';
             }
         }
     }
 
-    // Place player
-    board[player_y][player_x] = 'A';
+    // Place bullets and enemies from the index cells the window overlaps
+    int first_column = camera_x / GRID_CELL, last_column = (camera_x + view_w - 1) / GRID_CELL;
+    int first_row = camera_y / GRID_CELL, last_row = (camera_y + view_h - 1) / GRID_CELL;
+    for (int row = first_row; row <= last_row; row++) {
+        for (int column = first_column; column <= last_column; column++) {
+            for (int id = grid_head[row][column]; id >= 0; id = grid_next[id]) {
+                int x, y;
+                char c;
+                if (id < MAX_BULLETS) {
+                    x = game.bullets[id].x - camera_x;
+                    y = game.bullets[id].y - camera_y;
+                    c = '*';
+                } else {
+                    x = game.enemies[id - MAX_BULLETS].x - camera_x;
+                    y = game.enemies[id - MAX_BULLETS].y - camera_y;
+                    c = 'M';
+                }
 
-    // Place bullets
-    for (int i = 0; i < MAX_BULLETS; i++) {
-        if (bullets[i].active) {
-            board[bullets[i].y][bullets[i].x] = '*';
+                // Enemies are drawn over bullets
+                if (x >= 0 && x < view_w && y >= 0 && y < view_h && view[y][x] != 'M') {
+                    view[y][x] = c;
+                }
+            }
         }
     }
 
-    // Place enemies
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        if (enemies[i].active) {
-            board[enemies[i].y][enemies[i].x] = 'M';
-        }
+    // Place player under enemies and bullets on the same cell, but before
+    // the effects so debris never hides the tank
+    char* player_cell = &view[game.player_y - camera_y][game.player_x - camera_x];
+    if (*player_cell == ' ') {
+        *player_cell = 'A';
     }
 
-    // Draw the board
-    printf("\n");
-    for (int y = 0; y < HEIGHT; y++) {
-        printf("    ");
-        for (int x = 0; x < WIDTH; x++) {
-            char c = board[y][x];
+    // Effects layer goes on top of empty cells only
+    long long particles_start = now_us();
+    draw_particles(view_w, view_h);
+    frame_stats.particles_us += now_us() - particles_start;
+
+    *view_w_out = view_w;
+    *view_h_out = view_h;
+}
+
+// Build the view for this frame, then age the effects. Aging after the
+// draw means anything spawned during the tick is seen at least once.
+void compose_frame(int* view_w, int* view_h) {
+    frame_stats.particles_us = 0;
+    build_view(view_w, view_h);
+
+    long long particles_start = now_us();
+    update_particles();
+    frame_stats.particles_us += now_us() - particles_start;
+}
+
+// Render the game to the screen
+void render_game() {
+    long long render_start = now_us();
+
+    if (terminal_resized) {
+        update_view_size();
+    }
+
+    int view_w, view_h;
+    compose_frame(&view_w, &view_h);
+
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+
+    // Draw the board, only switching colour when it changes
+    frame_printf("\n");
+    for (int y = 0; y < view_h; y++) {
+        frame_printf("    ");
+        const char* current_color = NULL;  // NULL is the terminal default
+        for (int x = 0; x < view_w; x++) {
+            char c = view[y][x];
+            const char* color = NULL;
             if (c == '#') {
-                printf("%s%c%s", BLUE, c, RESET);
+                color = BLUE;
             } else if (c == 'A') {
-                printf("%s%c%s", GREEN, c, RESET);
+                color = GREEN;
             } else if (c == 'M') {
-                printf("%s%c%s", RED, c, RESET);
-            } else if (c == '*') {
-                printf("%s%c%s", YELLOW, c, RESET);
-            } else {
-                printf("%c", c);
+                color = RED;
+            } else if (c == '*' || c == '\'' || c == '.') {
+                color = YELLOW;
+            } else if (c == 'x' || c == 'o' || c == '+') {
+                color = MAGENTA;
+            }
+
+            if (color != current_color) {
+                frame_printf("%s", color != NULL ? color : RESET);
+                current_color = color;
+            }
+            if (frame_length < FRAME_BUFFER_SIZE - 1) {
+                frame_buffer[frame_length++] = c;
             }
         }
-        printf("\n");
+        frame_printf("%s\n", current_color != NULL ? RESET : "");
     }
 
     // Show player info
-    printf("\n    %sPlayer: %s%s", GREEN, player_name, RESET);
-    printf("    %sLives: %s", GREEN, RESET);
-    for (int i = 0; i < player_lives; i++) {
-        printf("%s♥ %s", RED, RESET);
+    frame_printf("\n    %sPlayer: %s%s", GREEN, player_name, RESET);
+    frame_printf("    %sLives: %s", GREEN, RESET);
+    for (int i = 0; i < game.player_lives; i++) {
+        frame_printf("%s♥ %s", RED, RESET);
+    }
+
+    frame_printf("    %sScore: %d%s\n", YELLOW, game.score, RESET);
+    frame_printf("\n    %sControls: A=Left D=Right%s F=Fire M=Menu Q=Quit%s\n",
+                 BLUE, large_map_mode ? " W=Up X=Down" : "", RESET);
+    frame_printf("    %s          %sT=Timing%s%s\n", BLUE, practice_mode ? "S=Save L=Load " : "",
+                 practice_mode ? " R=Rewind" : "", RESET);
+
+    frame_stats.render_us = now_us() - render_start;
+    if (show_frame_stats) {
+        frame_printf("    %sFrame: sim %lldus  fx %lldus (%d particles%s)  draw %lldus  total %lldus%s\n",
+                     CYAN, frame_stats.update_us, frame_stats.particles_us, particle_count,
+                     frame_stats.over_budget ? ", shedding" : "",
+                     frame_stats.render_us, frame_stats.total_us, RESET);
+        frame_printf("    %sFirst screen %.1fms after startup%s\n", CYAN,
+                     atomic_load_explicit(&time_to_first_frame_us, memory_order_relaxed) / 1000.0, RESET);
     }
 
-    printf("    %sScore: %d%s\n", YELLOW, score, RESET);
-    printf("\n    %sControls: A=Left D=Right F=Fire M=Menu Q=Quit%s\n", BLUE, RESET);
+    present_frame();
 }
 
-// Move the player left or right
+// Move the player left or right (and up or down on a large map)
 void move_player(char direction) {
-    if (direction == 'a' && player_x > 1) {
-        player_x--;
-    } else if (direction == 'd' && player_x < WIDTH - 2) {
-        player_x++;
+    if (direction == 'a' && game.player_x > 1) {
+        game.player_x--;
+    } else if (direction == 'd' && game.player_x < game.world_width - 2) {
+        game.player_x++;
+    } else if (direction == 'w' && game.player_y > 1) {
+        game.player_y--;
+    } else if (direction == 'x' && game.player_y < game.world_height - 2) {
+        game.player_y++;
     }
 }
 
 // Fire a bullet from player position
 void fire_bullet() {
     for (int i = 0; i < MAX_BULLETS; i++) {
-        if (!bullets[i].active) {
-            bullets[i].x = player_x;
-            bullets[i].y = player_y - 1;
-            bullets[i].active = 1;
+        if (!game.bullets[i].active) {
+            game.bullets[i].x = game.player_x;
+            game.bullets[i].y = game.player_y - 1;
+            game.bullets[i].active = 1;
+            game.shots_fired++;
+            spawn_muzzle_flash(game.player_x, game.player_y - 1);
             break;
         }
     }
@@ -433,33 +1226,50 @@ void fire_bullet() {
 void create_enemy() {
     // Count active enemies
     int active_count = 0;
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        if (enemies[i].active) {
+    for (int i = 0; i < game.enemy_limit; i++) {
+        if (game.enemies[i].active) {
             active_count++;
         }
     }
 
-    // If already max enemies, don't create
-    if (active_count >= MAX_ENEMIES) {
+    // If already at the limit, don't create
+    if (active_count >= game.enemy_limit) {
         return;
     }
 
     // Find an inactive slot
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        if (!enemies[i].active) {
+    for (int i = 0; i < game.enemy_limit; i++) {
+        if (!game.enemies[i].active) {
             // Choose a random x-position that is not free
             int new_x;
             int valid_position = 0;
             int attempts = 0;
 
+            if (bitboard_enabled) {
+                // Free spawn columns in one word: interior minus rows 1 and 2
+                unsigned int interior = ((1u << (game.world_width - 2)) - 1) << 1;
+                unsigned int free_columns = interior & ~(enemy_rows[1] | enemy_rows[2]);
+                if (free_columns != 0) {
+                    // Take the k-th free bit for a random k
+                    int k = game_rand() % __builtin_popcount(free_columns);
+                    while (k-- > 0) {
+                        free_columns &= free_columns - 1;
+                    }
+                    new_x = __builtin_ctz(free_columns);
+                } else {
+                    new_x = 1 + game_rand() % (game.world_width - 2);
+                }
+                valid_position = 1;
+            }
+
             // Retry if alredy there is an enemy
             while (!valid_position && attempts < 10) {
                 valid_position = 1;
-                new_x = 1 + rand() % (WIDTH - 2);
+                new_x = 1 + game_rand() % (game.world_width - 2);
 
                 // Check if this position is already occupied by another enemy
-                for (int j = 0; j < MAX_ENEMIES; j++) {
-                    if (enemies[j].active && enemies[j].x == new_x && enemies[j].y <= 2) {
+                for (int j = 0; j < game.enemy_limit; j++) {
+                    if (game.enemies[j].active && game.enemies[j].x == new_x && game.enemies[j].y <= 2) {
                         valid_position = 0;
                         break;
                     }
@@ -467,9 +1277,13 @@ void create_enemy() {
                 attempts++;
             }
 
-            enemies[i].x = new_x;
-            enemies[i].y = 1;
-            enemies[i].active = 1;
+            game.enemies[i].x = new_x;
+            game.enemies[i].y = 1;
+            game.enemies[i].active = 1;
+            schedule_enemy(i);
+            if (bitboard_enabled) {
+                bitboard_place(new_x, 1);
+            }
             break;
         }
     }
@@ -478,14 +1292,17 @@ void create_enemy() {
 // Check for collisions between bullets and enemies
 void check_collisions() {
     for (int b = 0; b < MAX_BULLETS; b++) {
-        if (bullets[b].active) {
-            for (int e = 0; e < MAX_ENEMIES; e++) {
-                if (enemies[e].active) {
-                    if (bullets[b].x == enemies[e].x && bullets[b].y == enemies[e].y) {
+        if (game.bullets[b].active) {
+            for (int e = 0; e < game.enemy_limit; e++) {
+                if (game.enemies[e].active) {
+                    if (game.bullets[b].x == game.enemies[e].x && game.bullets[b].y == game.enemies[e].y) {
                         // Collision detected
-                        bullets[b].active = 0;
-                        enemies[e].active = 0;
-                        score++;
+                        game.bullets[b].active = 0;
+                        game.enemies[e].active = 0;
+                        unschedule_enemy(e);
+                        game.score++;
+                        game.hits++;
+                        spawn_explosion(game.enemies[e].x, game.enemies[e].y);
 
                         // Create a new enemy to replace the destroyed one
                         create_enemy();
@@ -496,36 +1313,78 @@ void check_collisions() {
     }
 }
 
-// Show game over screen
-void show_game_over() {
-    clear_screen();
-    printf("\n\n");
-    printf("    %s╔═══════════════════════════════╗%s\n", RED, RESET);
-    printf("    %s║         GAME OVER             ║%s\n", RED, RESET);
-    printf("    %s╚═══════════════════════════════╝%s\n\n", RED, RESET);
-    printf("    %sPlayer: %s%s\n", GREEN, player_name, RESET);
-    printf("    %sFinal Score: %d%s\n\n", YELLOW, score, RESET);
+// Draw the game over screen and put the score on the leaderboard. The
+// part drawn so far is presented before the leaderboard is updated so its
+// messages appear underneath.
+void draw_game_over() {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n");
+    frame_printf("    %s╔═══════════════════════════════╗%s\n", RED, RESET);
+    frame_printf("    %s║         GAME OVER             ║%s\n", RED, RESET);
+    frame_printf("    %s╚═══════════════════════════════╝%s\n\n", RED, RESET);
+    frame_printf("    %sPlayer: %s%s\n", GREEN, player_name, RESET);
+    frame_printf("    %sFinal Score: %d%s\n\n", YELLOW, game.score, RESET);
+
+    FinishedGame finished;
+    describe_finished_game(&finished);
+
+    // Log this game for the stats command. The server hands that and the
+    // leaderboard update to its score writer, so workers never do file I/O.
+    if (server_mode) {
+        queue_finished_game(&finished);
+    } else if (!practice_mode) {
+        record_game_stats(&finished);
+    }
+
+    pthread_mutex_lock(&leaderboard_lock);
+    if (!high_scores_available()) {
+        frame_printf("    %s(leaderboard still loading, your score will be posted)%s\n\n", BLUE, RESET);
+        pthread_mutex_unlock(&leaderboard_lock);
+        frame_printf("    %sPress any key to continue...%s\n", GREEN, RESET);
+        return;
+    }
+
+    // Pick up scores other games have posted since we last looked
+    shared_board_sync();
 
     // Check if player already has an entry
     ScoreNode* existing = find_player_entry(player_name);
+    int posted = 0;
 
-    if (existing != NULL) {
+    if (practice_mode) {
+        // Rewinding makes practice scores meaningless for the leaderboard
+        frame_printf("    %sPractice games are not recorded%s\n\n", YELLOW, RESET);
+    } else if (existing != NULL) {
         // Player already has an entry, check if this score is better
-        if (score > existing->score) {
-            printf("    %s★ CONGRATULATIONS! NEW PERSONAL BEST! ★%s\n\n", MAGENTA, RESET);
-            add_high_score(player_name, score);
-            save_high_scores();
+        if (game.score > existing->score) {
+            frame_printf("    %s★ CONGRATULATIONS! NEW PERSONAL BEST! ★%s\n\n", MAGENTA, RESET);
+            posted = 1;
         } else {
-            printf("    %sYour best score is still %d%s\n\n", YELLOW, existing->score, RESET);
+            frame_printf("    %sYour best score is still %d%s\n\n", YELLOW, existing->score, RESET);
         }
-    } else if (is_high_score(score)) {
+    } else if (is_high_score(game.score)) {
         // New high score entry
-        printf("    %s★ CONGRATULATIONS! NEW HIGH SCORE! ★%s\n\n", MAGENTA, RESET);
-        add_high_score(player_name, score);
+        frame_printf("    %s★ CONGRATULATIONS! NEW HIGH SCORE! ★%s\n\n", MAGENTA, RESET);
+        posted = 1;
+    }
+
+    if (posted && !server_mode) {
+        present_screen();
+        frame_length = 0;
+        add_high_score(player_name, game.score);
         save_high_scores();
     }
 
-    printf("    %sPress any key to continue...%s\n", GREEN, RESET);
+    pthread_mutex_unlock(&leaderboard_lock);
+
+    frame_printf("    %sPress any key to continue...%s\n", GREEN, RESET);
+}
+
+// Show game over screen
+void show_game_over() {
+    draw_game_over();
+    present_screen();
 
     // Pause for a moment
     sleep(1);
@@ -540,21 +1399,28 @@ void show_game_over() {
     show_game_over_menu();
 }
 
+// Draw the menu offered after a game
+void draw_game_over_menu() {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n");
+    frame_printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
+    frame_printf("    %s║         GAME OVER             ║%s\n", YELLOW, RESET);
+    frame_printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
+
+    frame_printf("    %sWhat would you like to do?%s\n\n", GREEN, RESET);
+    frame_printf("    %s1.%s Play Again\n", CYAN, RESET);
+    frame_printf("    %s2.%s View High Scores\n", CYAN, RESET);
+    frame_printf("    %s3.%s Return to Main Menu\n", CYAN, RESET);
+    frame_printf("    %s4.%s Quit\n\n", CYAN, RESET);
+
+    frame_printf("    %sEnter your choice (1-4): %s", MAGENTA, RESET);
+}
+
 // Show menu after game over
 void show_game_over_menu() {
-    clear_screen();
-    printf("\n\n");
-    printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
-    printf("    %s║         GAME OVER             ║%s\n", YELLOW, RESET);
-    printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
-
-    printf("    %sWhat would you like to do?%s\n\n", GREEN, RESET);
-    printf("    %s1.%s Play Again\n", CYAN, RESET);
-    printf("    %s2.%s View High Scores\n", CYAN, RESET);
-    printf("    %s3.%s Return to Main Menu\n", CYAN, RESET);
-    printf("    %s4.%s Quit\n\n", CYAN, RESET);
-
-    printf("    %sEnter your choice (1-4): %s", MAGENTA, RESET);
+    draw_game_over_menu();
+    present_screen();
 
     // Get player choice
     char choice;
@@ -566,30 +1432,15 @@ void show_game_over_menu() {
                 valid_input = 1;
             } else {
                 // Show invalid input message
-                clear_screen();
-                printf("\n\n");
-                printf("    %s╔═══════════════════════════════╗%s\n", RED, RESET);
-                printf("    %s║         INVALID INPUT         ║%s\n", RED, RESET);
-                printf("    %s╚═══════════════════════════════╝%s\n\n", RED, RESET);
-                printf("    %sInvalid Input dalta h Gadhee common sense use krleeee....!!!%s\n\n", MAGENTA, RESET);
+                draw_invalid_input();
+                present_screen();
 
                 // Wait for 3 seconds
                 sleep(3);
 
                 // Show game over menu again
-                clear_screen();
-                printf("\n\n");
-                printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
-                printf("    %s║         GAME OVER             ║%s\n", YELLOW, RESET);
-                printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
-
-                printf("    %sWhat would you like to do?%s\n\n", GREEN, RESET);
-                printf("    %s1.%s Play Again\n", CYAN, RESET);
-                printf("    %s2.%s View High Scores\n", CYAN, RESET);
-                printf("    %s3.%s Return to Main Menu\n", CYAN, RESET);
-                printf("    %s4.%s Quit\n\n", CYAN, RESET);
-
-                printf("    %sEnter your choice (1-4): %s", MAGENTA, RESET);
+                draw_game_over_menu();
+                present_screen();
             }
         }
         usleep(100000);
@@ -615,92 +1466,382 @@ void show_game_over_menu() {
     }
 }
 
-// Load high scores from file into linked list
-void load_high_scores() {
+// Put one score from the file into the best-players table, which holds
+// at most MAX_HIGH_SCORES distinct names sorted by score (descending)
+static void keep_best_score(char names[][MAX_PLAYER_NAME], int* scores, int* count,
+                            const char* name, int name_length, int score) {
+    // Most lines of a long file cannot make the table at all
+    if (*count == MAX_HIGH_SCORES && score <= scores[*count - 1]) {
+        return;
+    }
+
+    int position = -1;
+    for (int i = 0; i < *count; i++) {
+        if (memcmp(names[i], name, name_length) == 0 && names[i][name_length] == '\0') {
+            position = i;
+            break;
+        }
+    }
+
+    if (position >= 0) {
+        if (score <= scores[position]) return;  // not this player's best
+    } else {
+        position = *count < MAX_HIGH_SCORES ? (*count)++ : MAX_HIGH_SCORES - 1;
+        memcpy(names[position], name, name_length);
+        names[position][name_length] = '\0';
+    }
+    scores[position] = score;
+
+    // Move the entry up until the table is sorted again
+    while (position > 0 && scores[position - 1] < scores[position]) {
+        int temp_score = scores[position - 1];
+        scores[position - 1] = scores[position];
+        scores[position] = temp_score;
+
+        char temp_name[MAX_PLAYER_NAME];
+        strcpy(temp_name, names[position - 1]);
+        strcpy(names[position - 1], names[position]);
+        strcpy(names[position], temp_name);
+        position--;
+    }
+}
+
+// One score line waiting to go into the prefix index. key holds the
+// first 8 bytes of the name, big-endian, so most comparisons stop there.
+typedef struct {
+    unsigned long long key;
+    long offset;
+    int length;
+    int score;
+} PrefixLine;
+
+static const char* prefix_line_text;
+
+static int compare_prefix_lines(const void* a, const void* b) {
+    const PrefixLine* x = (const PrefixLine*)a;
+    const PrefixLine* y = (const PrefixLine*)b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if (x->length <= 8 || y->length <= 8) return x->length - y->length;
+
+    int shorter = min(x->length, y->length);
+    int order = memcmp(prefix_line_text + x->offset + 8, prefix_line_text + y->offset + 8, shorter - 8);
+    return order ? order : x->length - y->length;
+}
+
+// Collect every "name score" line of a mapped score log, in file order.
+// Returns how many were found; the caller frees *lines_out.
+static int scan_score_lines(const char* text, size_t size, PrefixLine** lines_out) {
+    PrefixLine* lines = NULL;
+    int line_count = 0;
+    int line_capacity = 0;
+
+    const char* p = text;
+    const char* end = text + size;
+    while (p < end) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        const char* name = p;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+        int name_length = min((int)(p - name), MAX_PLAYER_NAME - 1);
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+        int negative = p < end && *p == '-';
+        if (negative) p++;
+        if (name_length > 0 && p < end && isdigit((unsigned char)*p)) {
+            long long score = 0;
+            while (p < end && isdigit((unsigned char)*p)) {
+                if (score < INT_MAX) score = score * 10 + (*p - '0');
+                p++;
+            }
+            if (score > INT_MAX) score = INT_MAX;
+            int value = negative ? -(int)score : (int)score;
+
+            if (line_count == line_capacity) {
+                int capacity = line_capacity ? line_capacity * 2 : 1024;
+                PrefixLine* grown = (PrefixLine*)realloc(lines, capacity * sizeof(PrefixLine));
+                if (grown) {
+                    lines = grown;
+                    line_capacity = capacity;
+                }
+            }
+            if (line_count < line_capacity) {
+                PrefixLine* line = &lines[line_count++];
+                line->key = 0;
+                for (int i = 0; i < 8; i++) {
+                    line->key = (line->key << 8) | (i < name_length ? (unsigned char)name[i] : 0);
+                }
+                line->offset = name - text;
+                line->length = name_length;
+                line->score = value;
+            }
+        }
+
+        // Anything else on the line is ignored
+        while (p < end && *p != '\n') p++;
+    }
+
+    *lines_out = lines;
+    return line_count;
+}
+
+// Scan the high score file into the name index and, if asked, the
+// linked list. The file is a log of "name score" lines, so the whole of
+// it is scanned for each player's best.
+static void read_high_score_file(int build_list) {
+    long long started = now_us();
+
     // Clear existing scores
-    free_score_list();
+    if (build_list) {
+        free_score_list();
+    }
+    prefix_index_clear();
 
-    FILE* file = fopen(HIGH_SCORE_FILE, "r");
-    if (!file) {
+    int fd = open(HIGH_SCORE_FILE, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
         // File doesn't exist.
-        num_high_scores = 0;
+        if (fd >= 0) close(fd);
+        if (build_list) num_high_scores = 0;
+        observe(&load_histogram, now_us() - started);
+        return;
+    }
+
+    const char* text = (const char*)mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        if (build_list) num_high_scores = 0;
+        observe(&load_histogram, now_us() - started);
         return;
     }
+    madvise((void*)text, info.st_size, MADV_SEQUENTIAL);
 
-    // Read all scores into a temporary array first for sorting
+    // Lines for the prefix index. They are added in name order, which
+    // keeps each insert on the path the previous one just walked.
+    PrefixLine* lines = NULL;
+    int line_count = scan_score_lines(text, info.st_size, &lines);
+
+    // Best distinct players, taking the lines in file order
     char names[MAX_HIGH_SCORES][MAX_PLAYER_NAME];
     int scores[MAX_HIGH_SCORES];
     int count = 0;
-
-    while (count < MAX_HIGH_SCORES && 
-           fscanf(file, "%s %d", names[count], &scores[count]) == 2) {
-        count++;
+    for (int i = 0; i < line_count; i++) {
+        keep_best_score(names, scores, &count, text + lines[i].offset, lines[i].length, lines[i].score);
     }
 
-    fclose(file);
-
-    // Sort scores in descending order (bubble sort)
-    for (int i = 0; i < count - 1; i++) {
-        for (int j = 0; j < count - i - 1; j++) {
-            if (scores[j] < scores[j + 1]) {
-                // Swap scores
-                int temp_score = scores[j];
-                scores[j] = scores[j + 1];
-                scores[j + 1] = temp_score;
+    prefix_line_text = text;
+    qsort(lines, line_count, sizeof(PrefixLine), compare_prefix_lines);
+    for (int i = 0; i < line_count; i++) {
+        prefix_index_add(text + lines[i].offset, lines[i].length, lines[i].score);
+    }
+    free(lines);
+    munmap((void*)text, info.st_size);
 
-                // Swap names
-                char temp_name[MAX_PLAYER_NAME];
-                strcpy(temp_name, names[j]);
-                strcpy(names[j], names[j + 1]);
-                strcpy(names[j + 1], temp_name);
-            }
-        }
+    if (!build_list) {
+        observe(&load_histogram, now_us() - started);
+        return;
     }
 
-    // Create linked list from sorted array
+    // Create linked list from the sorted table
+    ScoreNode* tail = NULL;
     for (int i = 0; i < count; i++) {
         ScoreNode* new_node = create_score_node(names[i], scores[i]);
         if (!new_node) continue;
 
         // Add to end of list (already sorted)
-        if (high_score_list == NULL) {
+        if (tail == NULL) {
             high_score_list = new_node;
         } else {
-            ScoreNode* current = high_score_list;
-            while (current->next != NULL) {
-                current = current->next;
-            }
-            current->next = new_node;
+            tail->next = new_node;
         }
+        tail = new_node;
 
         num_high_scores++;
     }
 
-    // Print debug message when scores are loaded
-    printf("    %sLoaded %d high scores into linked list%s\n", GREEN, num_high_scores, RESET);
-    usleep(500000); // Show message for 0.5 seconds
+    observe(&load_histogram, now_us() - started);
+    atomic_store_explicit(&metric_high_scores, num_high_scores, memory_order_relaxed);
+}
+
+// Load high scores from file into linked list and name index
+void load_high_scores() {
+    read_high_score_file(1);
+}
+
+// Index every player in the high score file, leaving the list alone
+void load_player_names() {
+    read_high_score_file(0);
+}
+
+// Background leaderboard loader. The process that created a shared
+// board seeds it from the text file here, merging with anything posted
+// meanwhile. Other processes already have the list from the board and
+// only index the file's names. Nothing else touches the list or index
+// until the load is marked done.
+static void* high_score_loader_main(void* unused) {
+    (void)unused;
+    if (shared_board != NULL && shared_board_seeding) {
+        load_high_scores();
+        for (ScoreNode* current = high_score_list; current != NULL && shared_board != NULL;
+             current = current->next) {
+            shared_board_add(current->name, current->score);
+        }
+        shared_board_seeding = 0;
+        shared_board_sync();
+    } else if (shared_board != NULL) {
+        load_player_names();
+        for (ScoreNode* current = high_score_list; current != NULL; current = current->next) {
+            prefix_index_add(current->name, (int)strlen(current->name), current->score);
+        }
+    } else {
+        load_high_scores();
+    }
+    atomic_store_explicit(&high_scores_loaded, 1, memory_order_release);
+    return NULL;
+}
+
+// Load the leaderboard on a thread of its own so the menu does not wait
+// for it (falls back to loading here if no thread can be started)
+void start_loading_high_scores() {
+    if (pthread_create(&high_score_loader, NULL, high_score_loader_main, NULL) == 0) {
+        high_scores_loading = 1;
+    } else {
+        high_score_loader_main(NULL);
+    }
+}
+
+// Wait for the background load; called before the list is first used
+void wait_for_high_scores() {
+    if (high_scores_loading) {
+        pthread_join(high_score_loader, NULL);
+        high_scores_loading = 0;
+    }
+}
+
+// Like wait_for_high_scores(), but only if the load has already finished.
+// Returns whether the list and name index can be used.
+int high_scores_ready() {
+    if (high_scores_loading && atomic_load_explicit(&high_scores_loaded, memory_order_acquire)) {
+        wait_for_high_scores();
+    }
+    return !high_scores_loading;
+}
+
+// Whether the leaderboard can be drawn right now. The terminal game just
+// waits for the load; server workers never block on it and say "loading".
+int high_scores_available() {
+    if (!server_mode) {
+        wait_for_high_scores();
+        return 1;
+    }
+    return high_scores_ready();
+}
+
+// Open the score log for appending, holding its flock. Another game may
+// have compacted the log while we waited, leaving our handle on the old
+// file, so check that the locked file is still the one at the path.
+static FILE* open_score_log() {
+    for (int attempt = 0; attempt < 8; attempt++) {
+        FILE* file = fopen(HIGH_SCORE_FILE, "a+");  // readable for compaction
+        if (!file) return NULL;
+        flock(fileno(file), LOCK_EX);
+
+        struct stat opened, current;
+        if (fstat(fileno(file), &opened) == 0 && stat(HIGH_SCORE_FILE, &current) == 0 &&
+            opened.st_dev == current.st_dev && opened.st_ino == current.st_ino) {
+            return file;
+        }
+        fclose(file);
+    }
+    return NULL;
+}
+
+// Rewrite the locked score log with one line per player, that player's
+// best. The new file is renamed over the old one, so a crash leaves one
+// or the other whole. Returns the new size, or -1 if nothing changed.
+static long compact_score_log(FILE* file) {
+    struct stat info;
+    if (fflush(file) != 0 || fstat(fileno(file), &info) != 0 || info.st_size == 0) {
+        return -1;
+    }
+    const char* text = (const char*)mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (text == MAP_FAILED) {
+        return -1;
+    }
+
+    // Sorting by name puts each player's lines next to each other
+    PrefixLine* lines = NULL;
+    int line_count = scan_score_lines(text, info.st_size, &lines);
+    prefix_line_text = text;
+    qsort(lines, line_count, sizeof(PrefixLine), compare_prefix_lines);
+
+    FILE* compacted = fopen(HIGH_SCORE_FILE ".tmp", "w");
+    int ok = compacted != NULL;
+    for (int i = 0; ok && i < line_count; i++) {
+        int best = lines[i].score;
+        while (i + 1 < line_count && compare_prefix_lines(&lines[i], &lines[i + 1]) == 0) {
+            i++;
+            if (lines[i].score > best) best = lines[i].score;
+        }
+        ok = fprintf(compacted, "%.*s %d\n", lines[i].length, text + lines[i].offset, best) > 0;
+    }
+    long size = ok ? ftell(compacted) : -1;
+    if (compacted != NULL && fclose(compacted) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(HIGH_SCORE_FILE ".tmp", HIGH_SCORE_FILE) != 0) {
+        unlink(HIGH_SCORE_FILE ".tmp");
+        size = -1;
+    }
+
+    free(lines);
+    munmap((void*)text, info.st_size);
+    return size;
 }
 
-// Save high scores from linked list to file
+// Save high scores from linked list to file. Only new or improved
+// entries are appended; older lines stay, and loading keeps each best.
+// The log is compacted once it grows past HIGH_SCORE_LOG_LIMIT.
 void save_high_scores() {
-    FILE* file = fopen(HIGH_SCORE_FILE, "w");
+    // Every change already went straight into the shared file
+    if (shared_board != NULL) {
+        return;
+    }
+
+    long long started = now_us();
+    FILE* file = open_score_log();
     if (!file) {
         // Can't write to file
         return;
     }
 
-    // Write high scores from linked list
-    ScoreNode* current = high_score_list;
-    while (current != NULL) {
-        fprintf(file, "%s %d\n", current->name, current->score);
-        current = current->next;
+    // Append the changed high scores from linked list
+    int saved = 0;
+    for (ScoreNode* current = high_score_list; current != NULL; current = current->next) {
+        if (current->unsaved) {
+            fprintf(file, "%s %d\n", current->name, current->score);
+            current->unsaved = 0;
+            saved++;
+        }
+    }
+
+    // Mostly distinct players can leave the log big after compacting, so
+    // wait until it has doubled again before the next rewrite
+    struct stat info;
+    if (fflush(file) == 0 && fstat(fileno(file), &info) == 0 &&
+        info.st_size > HIGH_SCORE_LOG_LIMIT && info.st_size > 2 * score_log_compacted_size) {
+        long compacted = compact_score_log(file);
+        if (compacted >= 0) {
+            score_log_compacted_size = compacted;
+        }
     }
 
     fclose(file);
+    observe(&save_histogram, now_us() - started);
 
     // Debug message
-    printf("    %sSaved %d high scores to file%s\n", GREEN, num_high_scores, RESET);
-    usleep(500000); // Show message for 0.5 seconds
+    if (!quiet_mode) {
+        printf("    %sSaved %d high scores to file%s\n", GREEN, saved, RESET);
+        usleep(500000); // Show message for 0.5 seconds
+    }
 }
 
 // Check if player already has an entry with the same name
@@ -719,16 +1860,33 @@ ScoreNode* find_player_entry(const char* name) {
 
 // Add a new high score to the linked list
 void add_high_score(const char* name, int score) {
-    // Check if player already has an entry
-    ScoreNode* existing = find_player_entry(name);
+    // Every name goes into the search index, whether or not it makes the list
+    prefix_index_add(name, (int)strlen(name), score);
+
+    // With a shared leaderboard the file is the list, so update it directly.
+    // If the board has to be given up, the score goes on the local list.
+    if (shared_board != NULL && shared_board_add(name, score)) {
+        shared_board_sync();
+        if (!quiet_mode) {
+            printf("    %sHigh score shared with every game: %s - %d%s\n", CYAN, name, score, RESET);
+            usleep(1000000); // Show message for 1 second
+        }
+        return;
+    }
+
+    // Check if player already has an entry
+    ScoreNode* existing = find_player_entry(name);
 
     if (existing != NULL) {
         // Player already has an entry
         if (score > existing->score) {
             // Update existing entry if new score is higher
-            printf("    %sUpdated high score: %s %d → %d%s\n", 
-                   CYAN, name, existing->score, score, RESET);
+            if (!quiet_mode) {
+                printf("    %sUpdated high score: %s %d → %d%s\n", 
+                       CYAN, name, existing->score, score, RESET);
+            }
             existing->score = score;
+            existing->unsaved = 1;
 
             // Re-sort the list (bubble sort)
             ScoreNode* i, *j;
@@ -760,24 +1918,28 @@ void add_high_score(const char* name, int score) {
             high_score_list = dummy.next;
         } else {
             // No update needed
-            printf("    %sYour current high score of %d is better than %d%s\n", 
-                   YELLOW, existing->score, score, RESET);
+            if (!quiet_mode) {
+                printf("    %sYour current high score of %d is better than %d%s\n", 
+                       YELLOW, existing->score, score, RESET);
+            }
         }
 
-        usleep(1000000); // Show message for 1 second
+        if (!quiet_mode) {
+            usleep(1000000); // Show message for 1 second
+        }
         return;
     }
 
     // Create new node for a new player
     ScoreNode* new_node = create_score_node(name, score);
     if (!new_node) return; // Failed to allocate memory
+    new_node->unsaved = 1;
 
     // Insert in sorted order (descending)
     if (high_score_list == NULL || score > high_score_list->score) {
         // Insert at beginning
         new_node->next = high_score_list;
         high_score_list = new_node;
-        num_high_scores++;
     } else {
         // Find position to insert
         ScoreNode* current = high_score_list;
@@ -788,30 +1950,25 @@ void add_high_score(const char* name, int score) {
         // Insert after current
         new_node->next = current->next;
         current->next = new_node;
+    }
+    num_high_scores++;
 
-        // Increment count if we haven't reached the maximum
-        if (num_high_scores < MAX_HIGH_SCORES) {
-            num_high_scores++;
-        } else {
-            // We're at maximum, need to remove the last node if we inserted elsewhere
-            if (new_node->next != NULL) {
-                // Find the node before the last one
-                ScoreNode* temp = high_score_list;
-                while (temp->next != NULL && temp->next->next != NULL) {
-                    temp = temp->next;
-                }
-                // Remove the last node
-                if (temp->next != NULL) {
-                    free(temp->next);
-                    temp->next = NULL;
-                }
-            }
+    // Past the maximum, the lowest entry drops off wherever the new one went
+    if (num_high_scores > MAX_HIGH_SCORES) {
+        ScoreNode* temp = high_score_list;
+        while (temp->next->next != NULL) {
+            temp = temp->next;
         }
+        free(temp->next);
+        temp->next = NULL;
+        num_high_scores--;
     }
 
     // Debug message for adding high score
-    printf("    %sAdded new high score: %s - %d%s\n", CYAN, name, score, RESET);
-    usleep(1000000); // Show message for 1 second
+    if (!quiet_mode) {
+        printf("    %sAdded new high score: %s - %d%s\n", CYAN, name, score, RESET);
+        usleep(1000000); // Show message for 1 second
+    }
 }
 
 // Check if a score is a high score
@@ -841,20 +1998,29 @@ int is_high_score(int score) {
     return 0;
 }
 
-// Display high scores
-void display_high_scores() {
-    clear_screen();
-    printf("\n\n");
-    printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
-    printf("    %s║         TOP 3 SCORES          ║%s\n", YELLOW, RESET);
-    printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
+// Draw the top of the leaderboard
+void draw_high_scores() {
+    pthread_mutex_lock(&leaderboard_lock);
+    int ready = high_scores_available();
+    if (ready) {
+        shared_board_sync();
+    }
+
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n");
+    frame_printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
+    frame_printf("    %s║         TOP 3 SCORES          ║%s\n", YELLOW, RESET);
+    frame_printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
 
     // Show info about data structure
-    printf("    %sHigh scores are stored in a linked list%s\n", BLUE, RESET);
-    printf("    %sBinary search implemented for score lookup%s\n\n", BLUE, RESET);
+    frame_printf("    %sHigh scores are stored in a linked list%s\n", BLUE, RESET);
+    frame_printf("    %sBinary search implemented for score lookup%s\n\n", BLUE, RESET);
 
-    if (num_high_scores == 0) {
-        printf("    %sNo high scores yet!%s\n\n", RED, RESET);
+    if (!ready) {
+        frame_printf("    %s(loading high scores...)%s\n\n", BLUE, RESET);
+    } else if (num_high_scores == 0) {
+        frame_printf("    %sNo high scores yet!%s\n\n", RED, RESET);
     } else {
         // Display only top 3 high scores from linked list
         ScoreNode* current = high_score_list;
@@ -877,7 +2043,7 @@ void display_high_scores() {
                 color = RED;
             }
 
-            printf("    %s%s%d. %s%-20s %d%s\n", 
+            frame_printf("    %s%s%d. %s%-20s %d%s\n", 
                   color, medal, i+1, medal, current->name, current->score, RESET);
 
             current = current->next;
@@ -885,40 +2051,90 @@ void display_high_scores() {
         }
 
         // Show total number of scores in database
-        printf("\n    %s(Showing top 3 of %d high scores)%s\n", MAGENTA, num_high_scores, RESET);
-        printf("\n");
+        frame_printf("\n    %s(Showing top 3 of %d high scores)%s\n", MAGENTA, num_high_scores, RESET);
+        frame_printf("\n");
     }
 
-    printf("    %sPress any key to continue...%s\n", GREEN, RESET);
+    pthread_mutex_unlock(&leaderboard_lock);
+
+    frame_printf("    %sPress S to search players, any other key to continue...%s\n", GREEN, RESET);
+}
+
+// Display high scores
+void display_high_scores() {
+    draw_high_scores();
+    present_screen();
 
     // Wait for key press
     char c;
     while (read(STDIN_FILENO, &c, 1) <= 0) {
         usleep(100000);
     }
+
+    if (c == 's' || c == 'S') {
+        search_players();
+    }
 }
 
-// Display developers information
-void display_about_developers() {
-    clear_screen();
-    printf("\n\n");
-    printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
-    printf("    %s║       ABOUT DEVELOPERS        ║%s\n", YELLOW, RESET);
-    printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
+// Player search page: results update with every key
+void search_players() {
+    char query[MAX_PLAYER_NAME] = "";
+    int length = 0;
+
+    draw_player_search(query);
+    present_screen();
+
+    while (1) {
+        char c;
+        if (read(STDIN_FILENO, &c, 1) <= 0) {
+            usleep(10000);
+            continue;
+        }
+
+        if (c == '\n' || c == '\r') {
+            return;
+        } else if ((c == 127 || c == '\b') && length > 0) {
+            query[--length] = '\0';
+        } else if (isgraph((unsigned char)c) && length < MAX_PLAYER_NAME - 1) {
+            query[length++] = c;
+            query[length] = '\0';
+        } else {
+            continue;
+        }
 
-    printf("    %sDevelopers:%s\n\n", GREEN, RESET);
+        draw_player_search(query);
+        present_screen();
+    }
+}
+
+// Draw the developers page
+void draw_about_developers() {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n");
+    frame_printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
+    frame_printf("    %s║       ABOUT DEVELOPERS        ║%s\n", YELLOW, RESET);
+    frame_printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
+
+    frame_printf("    %sDevelopers:%s\n\n", GREEN, RESET);
 
-    printf("    %sTanvi Jamwal%s\n", MAGENTA, RESET);
-    printf("    24bcs084\n");
-    printf("    B Tech CSE 1st year\n");
-    printf("    Shri Mata Vaishno Devi University\n\n");
+    frame_printf("    %sTanvi Jamwal%s\n", MAGENTA, RESET);
+    frame_printf("    24bcs084\n");
+    frame_printf("    B Tech CSE 1st year\n");
+    frame_printf("    Shri Mata Vaishno Devi University\n\n");
 
-    printf("    %sHarsh Bardhan%s\n", MAGENTA, RESET);
-    printf("    24bcs026\n");
-    printf("    B Tech CSE 1st year\n");
-    printf("    Shri Mata Vaishno Devi University\n\n");
+    frame_printf("    %sHarsh Bardhan%s\n", MAGENTA, RESET);
+    frame_printf("    24bcs026\n");
+    frame_printf("    B Tech CSE 1st year\n");
+    frame_printf("    Shri Mata Vaishno Devi University\n\n");
 
-    printf("    %sPress any key to continue...%s\n", GREEN, RESET);
+    frame_printf("    %sPress any key to continue...%s\n", GREEN, RESET);
+}
+
+// Display developers information
+void display_about_developers() {
+    draw_about_developers();
+    present_screen();
 
     // Wait for key press
     char c;
@@ -938,6 +2154,7 @@ ScoreNode* create_score_node(const char* name, int score) {
     if (new_node) {
         strcpy(new_node->name, name);
         new_node->score = score;
+        new_node->unsaved = 0;
         new_node->next = NULL;
     }
     return new_node;
@@ -1002,27 +2219,3642 @@ ScoreNode* binary_search_score(int target_score) {
     return result;
 }
 
-// Main function
-int main() {
-    // Initialize random number generator
-    srand(time(NULL));
+// Prefix index over every player name in the score file. Edges carry
+// whole runs of characters (a radix tree), children hang off their
+// parent in a sibling list, and each node keeps the best score found
+// anywhere under it. A prefix query walks down to the prefix and then
+// expands nodes best-first, so the top matches come out in score order
+// after visiting only a few nodes.
+
+// Start a new empty index
+void prefix_index_clear() {
+    prefix_node_count = 0;
+    prefix_player_count = 0;
+    prefix_text_length = 0;
+}
 
-    // Load high scores
-    load_high_scores();
+// Append a node, growing the pool as needed; returns its index or -1
+static int prefix_new_node(int label, int label_length, int best, int player) {
+    if (prefix_node_count == prefix_node_capacity) {
+        int capacity = prefix_node_capacity ? prefix_node_capacity * 2 : 1024;
+        PrefixNode* nodes = (PrefixNode*)realloc(prefix_nodes, capacity * sizeof(PrefixNode));
+        if (nodes == NULL) return -1;
+        prefix_nodes = nodes;
+        prefix_node_capacity = capacity;
+    }
 
-    // Set up the terminal
-    setup_terminal();
+    PrefixNode* node = &prefix_nodes[prefix_node_count];
+    node->label = label;
+    node->label_length = (unsigned char)label_length;
+    node->first = label_length > 0 ? (unsigned char)prefix_text[label] : 0;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->best = best;
+    node->player = player;
+    return prefix_node_count++;
+}
 
-    // Start the game
-    show_welcome();
+// Store a new player's name; returns the player index or -1
+static int prefix_new_player(const char* name, int name_length, int score) {
+    if (prefix_player_count == prefix_player_capacity) {
+        int capacity = prefix_player_capacity ? prefix_player_capacity * 2 : 1024;
+        PrefixPlayer* players = (PrefixPlayer*)realloc(prefix_players, capacity * sizeof(PrefixPlayer));
+        if (players == NULL) return -1;
+        prefix_players = players;
+        prefix_player_capacity = capacity;
+    }
+    if (prefix_text_length + name_length + 1 > prefix_text_capacity) {
+        size_t capacity = prefix_text_capacity ? prefix_text_capacity * 2 : 16384;
+        while (capacity < prefix_text_length + name_length + 1) {
+            capacity *= 2;
+        }
+        char* text = (char*)realloc(prefix_text, capacity);
+        if (text == NULL) return -1;
+        prefix_text = text;
+        prefix_text_capacity = capacity;
+    }
 
-    // Clean up
-    reset_terminal();
-    clear_screen();
-    printf("\nThanks for playing!\n\n");
+    PrefixPlayer* player = &prefix_players[prefix_player_count];
+    player->name = (int)prefix_text_length;
+    player->score = score;
+    memcpy(prefix_text + prefix_text_length, name, name_length);
+    prefix_text[prefix_text_length + name_length] = '\0';
+    prefix_text_length += name_length + 1;
+    return prefix_player_count++;
+}
 
-    // Free memory used by high score linked list
-    free_score_list();
+// Add a name, or raise its best score. Costs one walk down the tree.
+void prefix_index_add(const char* name, int name_length, int score) {
+    if (prefix_node_count == 0 && prefix_new_node(0, 0, score, -1) < 0) {
+        return;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    int node = 0;
+    int position = 0;
+    while (1) {
+        if (prefix_nodes[node].best < score) {
+            prefix_nodes[node].best = score;
+        }
+
+        if (position == name_length) {
+            // The name ends here
+            int player = prefix_nodes[node].player;
+            if (player < 0) {
+                prefix_nodes[node].player = prefix_new_player(name, name_length, score);
+            } else if (prefix_players[player].score < score) {
+                prefix_players[player].score = score;
+            }
+            return;
+        }
+
+        // Find the child starting with the next character
+        unsigned char c = (unsigned char)name[position];
+        int previous = -1;
+        int child = prefix_nodes[node].first_child;
+        while (child >= 0 && prefix_nodes[child].first != c) {
+            previous = child;
+            child = prefix_nodes[child].next_sibling;
+        }
+
+        if (child < 0) {
+            // Nothing shares this character: the rest of the name is one new
+            // leaf, put first so names added in sorted order find it at once
+            int player = prefix_new_player(name, name_length, score);
+            if (player < 0) return;
+            int leaf = prefix_new_node(prefix_players[player].name + position, name_length - position, score, player);
+            if (leaf < 0) return;
+
+            prefix_nodes[leaf].next_sibling = prefix_nodes[node].first_child;
+            prefix_nodes[node].first_child = leaf;
+            return;
+        }
+
+        // Follow the edge as far as it matches
+        int common = 1;
+        while (common < prefix_nodes[child].label_length && position + common < name_length &&
+               prefix_text[prefix_nodes[child].label + common] == name[position + common]) {
+            common++;
+        }
+
+        if (common < prefix_nodes[child].label_length) {
+            // Split the edge; the new node takes the child's place in the list
+            int middle = prefix_new_node(prefix_nodes[child].label, common, prefix_nodes[child].best, -1);
+            if (middle < 0) return;
+            prefix_nodes[middle].first_child = child;
+            prefix_nodes[middle].next_sibling = prefix_nodes[child].next_sibling;
+            prefix_nodes[child].next_sibling = -1;
+            prefix_nodes[child].label += common;
+            prefix_nodes[child].label_length -= common;
+            prefix_nodes[child].first = (unsigned char)prefix_text[prefix_nodes[child].label];
+            if (previous < 0) {
+                prefix_nodes[node].first_child = middle;
+            } else {
+                prefix_nodes[previous].next_sibling = middle;
+            }
+            child = middle;
+        }
+
+        node = child;
+        position += common;
+    }
+}
+
+// Push onto the max-heap used by prefix_index_search(). Every entry holds
+// a player scoring at least its key, so when the heap is full the weakest
+// entry can make way: the rest still cover far more than SEARCH_MATCHES
+// results at least as good.
+static void prefix_heap_push(PrefixHeapEntry* heap, int* size, int key, int index, int is_player) {
+    int i;
+    if (*size < PREFIX_HEAP_SIZE) {
+        i = (*size)++;
+    } else {
+        // The weakest entry is a leaf, in the second half of the array
+        i = PREFIX_HEAP_SIZE / 2;
+        for (int leaf = i + 1; leaf < PREFIX_HEAP_SIZE; leaf++) {
+            if (heap[leaf].key < heap[i].key) i = leaf;
+        }
+        if (heap[i].key >= key) return;
+    }
+
+    while (i > 0 && heap[(i - 1) / 2].key < key) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i].key = key;
+    heap[i].index = index;
+    heap[i].is_player = is_player;
+}
+
+// Pop the largest entry
+static PrefixHeapEntry prefix_heap_pop(PrefixHeapEntry* heap, int* size) {
+    PrefixHeapEntry top = heap[0];
+    PrefixHeapEntry last = heap[--(*size)];
+
+    int i = 0;
+    while (2 * i + 1 < *size) {
+        int child = 2 * i + 1;
+        if (child + 1 < *size && heap[child + 1].key > heap[child].key) {
+            child++;
+        }
+        if (heap[child].key <= last.key) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+// Best-scoring players whose names start with prefix, highest first.
+// Fills at most limit names and scores and returns how many.
+int prefix_index_search(const char* prefix, int limit, const char** names, int* scores) {
+    if (prefix_node_count == 0) return 0;
+
+    // Walk down to the node covering the whole prefix
+    int prefix_length = (int)strlen(prefix);
+    int node = 0;
+    int position = 0;
+    while (position < prefix_length) {
+        int child = prefix_nodes[node].first_child;
+        while (child >= 0 && prefix_nodes[child].first != (unsigned char)prefix[position]) {
+            child = prefix_nodes[child].next_sibling;
+        }
+        if (child < 0) return 0;
+
+        int length = min(prefix_nodes[child].label_length, prefix_length - position);
+        if (memcmp(prefix_text + prefix_nodes[child].label, prefix + position, length) != 0) {
+            return 0;
+        }
+        node = child;
+        position += prefix_nodes[child].label_length;
+    }
+
+    // Expand the most promising node or take the best player each time
+    PrefixHeapEntry heap[PREFIX_HEAP_SIZE];
+    int size = 0;
+    int found = 0;
+    prefix_heap_push(heap, &size, prefix_nodes[node].best, node, 0);
+    while (size > 0 && found < limit) {
+        PrefixHeapEntry entry = prefix_heap_pop(heap, &size);
+        if (entry.is_player) {
+            names[found] = prefix_text + prefix_players[entry.index].name;
+            scores[found] = prefix_players[entry.index].score;
+            found++;
+            continue;
+        }
+
+        PrefixNode* expanded = &prefix_nodes[entry.index];
+        if (expanded->player >= 0) {
+            prefix_heap_push(heap, &size, prefix_players[expanded->player].score, expanded->player, 1);
+        }
+        for (int child = expanded->first_child; child >= 0; child = prefix_nodes[child].next_sibling) {
+            prefix_heap_push(heap, &size, prefix_nodes[child].best, child, 0);
+        }
+    }
+    return found;
+}
+
+// Draw the name prompt with the best matching players underneath
+void draw_name_prompt(const char* typed) {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n    %sEnter your name: %s%s\0337", YELLOW, RESET, typed);
+
+    const char* names[NAME_MATCHES];
+    int scores[NAME_MATCHES];
+    int found = 0;
+    pthread_mutex_lock(&leaderboard_lock);
+    int ready = high_scores_ready();
+    if (ready && typed[0] != '\0') {
+        found = prefix_index_search(typed, NAME_MATCHES, names, scores);
+    }
+
+    if (!ready) {
+        frame_printf("\n\n    %s(loading player names...)%s", BLUE, RESET);
+    } else if (found > 0) {
+        frame_printf("\n\n    %sReturning players (Tab completes the first):%s\n", CYAN, RESET);
+        for (int i = 0; i < found; i++) {
+            frame_printf("      %s%-20s%s %d\n", i == 0 ? GREEN : RESET, names[i], RESET, scores[i]);
+        }
+    }
+    pthread_mutex_unlock(&leaderboard_lock);
+
+    // Put the cursor back after what has been typed
+    frame_printf("\0338");
+}
+
+// Replace a partly typed name with the best-scoring match for it
+void complete_player_name(char* typed, int* length) {
+    const char* names[1];
+    int scores[1];
+
+    pthread_mutex_lock(&leaderboard_lock);
+    if (high_scores_ready() && typed[0] != '\0' && prefix_index_search(typed, 1, names, scores) == 1) {
+        snprintf(typed, MAX_PLAYER_NAME, "%s", names[0]);
+        *length = (int)strlen(typed);
+    }
+    pthread_mutex_unlock(&leaderboard_lock);
+}
+
+// Draw the player search page for a prefix
+void draw_player_search(const char* query) {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H");
+    frame_printf("\n\n");
+    frame_printf("    %s╔═══════════════════════════════╗%s\n", YELLOW, RESET);
+    frame_printf("    %s║         PLAYER SEARCH         ║%s\n", YELLOW, RESET);
+    frame_printf("    %s╚═══════════════════════════════╝%s\n\n", YELLOW, RESET);
+
+    const char* names[SEARCH_MATCHES];
+    int scores[SEARCH_MATCHES];
+    pthread_mutex_lock(&leaderboard_lock);
+    if (!high_scores_available()) {
+        frame_printf("    %s(loading player names...)%s\n", BLUE, RESET);
+    } else {
+        long long started = now_us();
+        int found = prefix_index_search(query, SEARCH_MATCHES, names, scores);
+        long long elapsed = now_us() - started;
+
+        for (int i = 0; i < found; i++) {
+            frame_printf("    %s%2d.%s %-20s %d\n", CYAN, i + 1, RESET, names[i], scores[i]);
+        }
+        if (found == 0) {
+            frame_printf("    %sNo players start with \"%s\"%s\n", RED, query, RESET);
+        }
+        frame_printf("\n    %s(%d names indexed, search took %lldus)%s\n", MAGENTA, prefix_player_count, elapsed, RESET);
+    }
+    pthread_mutex_unlock(&leaderboard_lock);
+
+    frame_printf("\n    %sType to search, Enter to go back%s\n\n", GREEN, RESET);
+    frame_printf("    %sSearch: %s%s", YELLOW, RESET, query);
+}
+
+// Advance the game's own random generator (xorshift32). Keeping it in
+// GameState means a restored snapshot replays the same enemy moves.
+unsigned int game_rand() {
+    unsigned int x = game.rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    game.rng = x;
+    return x & 0x7fffffff;
+}
+
+// Record the current state in the rewind history, overwriting the oldest
+void take_snapshot() {
+    memcpy(&snapshot_ring[snapshot_head], &game, sizeof(GameState));
+    snapshot_head = (snapshot_head + 1) % SNAPSHOT_HISTORY;
+    if (snapshot_count < SNAPSHOT_HISTORY) {
+        snapshot_count++;
+    }
+}
+
+// Step back to the most recent snapshot (returns 0 if history is empty)
+int rewind_snapshot() {
+    if (snapshot_count == 0) {
+        return 0;
+    }
+
+    snapshot_head = (snapshot_head + SNAPSHOT_HISTORY - 1) % SNAPSHOT_HISTORY;
+    snapshot_count--;
+    memcpy(&game, &snapshot_ring[snapshot_head], sizeof(GameState));
+    return 1;
+}
+
+// Save the game in progress
+int save_game() {
+    FILE* file = fopen(SAVE_GAME_FILE, "wb");
+    if (!file) {
+        return 0;
+    }
+
+    unsigned int header[2] = { SAVE_GAME_MAGIC, sizeof(GameState) };
+    int ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+             fwrite(&game, sizeof(GameState), 1, file) == 1;
+    fclose(file);
+    return ok;
+}
+
+// Resume a saved game (the current game is untouched if the file is bad)
+int load_game() {
+    FILE* file = fopen(SAVE_GAME_FILE, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    unsigned int header[2];
+    GameState loaded;
+    int ok = fread(header, sizeof(header), 1, file) == 1 &&
+             header[0] == SAVE_GAME_MAGIC && header[1] == sizeof(GameState) &&
+             fread(&loaded, sizeof(GameState), 1, file) == 1;
+    fclose(file);
+
+    // Reject anything that would draw outside the board
+    if (ok && (loaded.world_width < WIDTH || loaded.world_width > WORLD_WIDTH ||
+               loaded.world_height < HEIGHT || loaded.world_height > WORLD_HEIGHT ||
+               loaded.enemy_limit < 0 || loaded.enemy_limit > MAX_WORLD_ENEMIES)) {
+        ok = 0;
+    }
+    if (ok && (loaded.player_x < 1 || loaded.player_x > loaded.world_width - 2 ||
+               loaded.player_y < 1 || loaded.player_y > loaded.world_height - 2 || loaded.rng == 0)) {
+        ok = 0;
+    }
+    if (ok && (loaded.player_lives < 1 || loaded.player_lives > STARTING_LIVES || loaded.score < 0 ||
+               loaded.ticks < 0 || loaded.shots_fired < 0 || loaded.hits < 0)) {
+        ok = 0;
+    }
+    for (int i = 0; ok && i < MAX_BULLETS; i++) {
+        if (loaded.bullets[i].active &&
+            (loaded.bullets[i].x < 0 || loaded.bullets[i].x >= loaded.world_width ||
+             loaded.bullets[i].y < 0 || loaded.bullets[i].y >= loaded.world_height)) {
+            ok = 0;
+        }
+    }
+    for (int i = 0; ok && i < WHEEL_BUCKETS; i++) {
+        if (loaded.wheel_heads[i] < -1 || loaded.wheel_heads[i] >= loaded.enemy_limit) {
+            ok = 0;
+        }
+    }
+    for (int i = 0; ok && i < MAX_WORLD_ENEMIES; i++) {
+        const Enemy* enemy = &loaded.enemies[i];
+        if (enemy->wheel_bucket < -1 || enemy->wheel_bucket >= WHEEL_BUCKETS ||
+            enemy->wheel_prev < -1 || enemy->wheel_prev >= loaded.enemy_limit ||
+            enemy->wheel_next < -1 || enemy->wheel_next >= loaded.enemy_limit) {
+            ok = 0;
+        }
+        if (loaded.enemies[i].active &&
+            (i >= loaded.enemy_limit ||
+             loaded.enemies[i].x < 0 || loaded.enemies[i].x >= loaded.world_width ||
+             loaded.enemies[i].y < 0 || loaded.enemies[i].y >= loaded.world_height)) {
+            ok = 0;
+        }
+    }
+
+    // Every active enemy must be in exactly one wheel list, linked both
+    // ways, or move_due_enemies() could loop forever or never move it
+    int scheduled = 0;
+    for (int bucket = 0; ok && bucket < WHEEL_BUCKETS; bucket++) {
+        int previous = -1;
+        for (int i = loaded.wheel_heads[bucket]; ok && i >= 0; i = loaded.enemies[i].wheel_next) {
+            const Enemy* enemy = &loaded.enemies[i];
+            if (!enemy->active || enemy->wheel_bucket != bucket || enemy->wheel_prev != previous ||
+                enemy->next_move <= loaded.ticks || ++scheduled > loaded.enemy_limit) {
+                ok = 0;
+            }
+            previous = i;
+        }
+    }
+    for (int i = 0; ok && i < MAX_WORLD_ENEMIES; i++) {
+        if (loaded.enemies[i].active != (loaded.enemies[i].wheel_bucket >= 0)) {
+            ok = 0;
+        }
+    }
+
+    if (ok) {
+        memcpy(&game, &loaded, sizeof(GameState));
+        snapshot_head = 0;
+        snapshot_count = 0;
+    }
+    return ok;
+}
+
+// Fill move_delay_threshold; run once by whichever thread needs it first
+static void fill_move_delays() {
+    double survive = 2147483648.0;
+    for (int k = 0; k < MOVE_DELAY_TABLE; k++) {
+        move_delay_threshold[k] = survive >= 2147483647.0 ? 2147483647u : (unsigned int)survive;
+        survive *= 1.0 - 1.0 / ENEMY_MOVE_CHANCE;
+    }
+}
+
+// Ticks until an enemy's next step, drawn from the same geometric
+// distribution as rolling 1 in ENEMY_MOVE_CHANCE every tick
+int draw_move_delay() {
+    pthread_once(&move_delays_once, fill_move_delays);
+
+    int delay = 0;
+    while (1) {
+        // Smallest k with u >= threshold[k]; thresholds fall as k grows
+        unsigned int u = game_rand();
+        int low = 1, high = MOVE_DELAY_TABLE - 1;
+        if (u < move_delay_threshold[high]) {
+            // Beyond the table; the wait is memoryless so just keep going
+            delay += high;
+            continue;
+        }
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (u >= move_delay_threshold[mid]) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+        return delay + low;
+    }
+}
+
+// Put an enemy into the timing wheel for its next move. Moves within
+// WHEEL_SLOTS ticks go in the first level, one slot per tick; later ones
+// go in the second level, one slot per WHEEL_SLOTS ticks, and are moved
+// down when their block comes round.
+static void wheel_insert(int i) {
+    Enemy* enemy = &game.enemies[i];
+    int delta = enemy->next_move - game.ticks;
+    int bucket;
+
+    if (delta < WHEEL_SLOTS) {
+        bucket = enemy->next_move & (WHEEL_SLOTS - 1);
+    } else if (delta < (WHEEL_SLOTS - 1) * WHEEL_SLOTS) {
+        bucket = WHEEL_SLOTS + ((enemy->next_move >> WHEEL_BITS) & (WHEEL_SLOTS - 1));
+    } else {
+        bucket = WHEEL_FAR;
+    }
+
+    enemy->wheel_bucket = (short)bucket;
+    enemy->wheel_prev = -1;
+    enemy->wheel_next = game.wheel_heads[bucket];
+    if (enemy->wheel_next >= 0) {
+        game.enemies[enemy->wheel_next].wheel_prev = (short)i;
+    }
+    game.wheel_heads[bucket] = (short)i;
+}
+
+// Draw the next move for an enemy that just spawned or moved
+void schedule_enemy(int i) {
+    unschedule_enemy(i);
+    game.enemies[i].next_move = game.ticks + draw_move_delay();
+    wheel_insert(i);
+}
+
+// Take an enemy out of the wheel (destroyed or reached the bottom)
+void unschedule_enemy(int i) {
+    Enemy* enemy = &game.enemies[i];
+    if (enemy->wheel_bucket < 0) return;
+
+    if (enemy->wheel_prev >= 0) {
+        game.enemies[enemy->wheel_prev].wheel_next = enemy->wheel_next;
+    } else {
+        game.wheel_heads[enemy->wheel_bucket] = enemy->wheel_next;
+    }
+    if (enemy->wheel_next >= 0) {
+        game.enemies[enemy->wheel_next].wheel_prev = enemy->wheel_prev;
+    }
+    enemy->wheel_bucket = -1;
+}
+
+// Detach a whole wheel list and return its first enemy
+static int wheel_take(int bucket) {
+    int first = game.wheel_heads[bucket];
+    game.wheel_heads[bucket] = -1;
+    for (int i = first; i >= 0; i = game.enemies[i].wheel_next) {
+        game.enemies[i].wheel_bucket = -1;
+    }
+    return first;
+}
+
+// Step every enemy due this tick; nothing else is looked at
+void move_due_enemies() {
+    // Entering a new block: spread the second-level slot over the first level
+    if ((game.ticks & (WHEEL_SLOTS - 1)) == 0) {
+        int i = wheel_take(WHEEL_SLOTS + ((game.ticks >> WHEEL_BITS) & (WHEEL_SLOTS - 1)));
+        while (i >= 0) {
+            int next = game.enemies[i].wheel_next;
+            wheel_insert(i);
+            i = next;
+        }
+
+        i = wheel_take(WHEEL_FAR);
+        while (i >= 0) {
+            int next = game.enemies[i].wheel_next;
+            wheel_insert(i);
+            i = next;
+        }
+    }
+
+    int i = wheel_take(game.ticks & (WHEEL_SLOTS - 1));
+    while (i >= 0) {
+        int next = game.enemies[i].wheel_next;
+        Enemy* enemy = &game.enemies[i];
+
+        int from_x = enemy->x, from_y = enemy->y;
+        if (ai_mode) {
+            // Steer toward the player using the shared field
+            enemy->x = flow_next_x[enemy->y][enemy->x];
+        }
+        enemy->y++;
+
+        if (bitboard_enabled) {
+            // The bottom row is checked as a whole once everyone has moved
+            bitboard_move(from_x, from_y, enemy->x, enemy->y);
+            schedule_enemy(i);
+        } else if (enemy->y >= game.world_height - 1) {
+            // Check if enemy reached bottom
+            enemy->active = 0;
+            game.player_lives--;
+            // Create a new enemy to replace the one that reached the bottom
+            create_enemy();
+        } else {
+            schedule_enemy(i);
+        }
+
+        i = next;
+    }
+
+    if (bitboard_enabled && enemy_rows[game.world_height - 1] != 0) {
+        bitboard_bottom_row();
+    }
+}
+
+// Recompute the bitboards from the entity arrays (new game, rewind, load)
+void bitboard_rebuild() {
+    bitboard_enabled = bitboard_mode && game.world_width <= BITBOARD_MAX_WIDTH && game.world_height <= HEIGHT;
+    if (!bitboard_enabled) return;
+
+    memset(enemy_rows, 0, sizeof(enemy_rows));
+    memset(enemy_cell_count, 0, sizeof(enemy_cell_count));
+    for (int i = 0; i < game.enemy_limit; i++) {
+        if (game.enemies[i].active) {
+            bitboard_place(game.enemies[i].x, game.enemies[i].y);
+        }
+    }
+}
+
+// An enemy arrived on a cell
+void bitboard_place(int x, int y) {
+    enemy_cell_count[y][x]++;
+    enemy_rows[y] |= 1u << x;
+}
+
+// An enemy left a cell
+void bitboard_remove(int x, int y) {
+    if (enemy_cell_count[y][x] > 0 && --enemy_cell_count[y][x] == 0) {
+        enemy_rows[y] &= ~(1u << x);
+    }
+}
+
+// An enemy stepped down, straight or diagonally. Only straight steps can
+// swap with a rising bullet, so only those are remembered for the tick.
+void bitboard_move(int from_x, int from_y, int to_x, int to_y) {
+    bitboard_remove(from_x, from_y);
+    bitboard_place(to_x, to_y);
+    if (to_x == from_x && to_y == from_y + 1) {
+        enemy_down_rows[from_y] |= 1u << from_x;
+    }
+}
+
+// Remember where the bullets were before this tick's moves
+void bitboard_begin_tick() {
+    memset(enemy_down_rows, 0, sizeof(enemy_down_rows));
+    memset(bullet_from_rows, 0, sizeof(bullet_from_rows));
+    for (int i = 0; i < MAX_BULLETS; i++) {
+        if (game.bullets[i].active) {
+            bullet_from_rows[game.bullets[i].y] |= 1u << game.bullets[i].x;
+        }
+    }
+}
+
+// Enemies that reached the bottom row cost a life each
+void bitboard_bottom_row() {
+    int bottom = game.world_height - 1;
+    for (int i = 0; i < game.enemy_limit && enemy_rows[bottom] != 0; i++) {
+        Enemy* enemy = &game.enemies[i];
+        if (enemy->active && enemy->y == bottom) {
+            enemy->active = 0;
+            unschedule_enemy(i);
+            bitboard_remove(enemy->x, enemy->y);
+            game.player_lives--;
+            // Create a new enemy to replace the one that reached the bottom
+            create_enemy();
+        }
+    }
+}
+
+// Destroy an enemy hit by a bullet
+static void bitboard_destroy(int e) {
+    Enemy* enemy = &game.enemies[e];
+    enemy->active = 0;
+    unschedule_enemy(e);
+    bitboard_remove(enemy->x, enemy->y);
+    game.score++;
+    game.hits++;
+    spawn_explosion(enemy->x, enemy->y);
+
+    // Create a new enemy to replace the destroyed one
+    create_enemy();
+}
+
+// Collisions as row masks. A bullet hits if an enemy shares its cell, or
+// if it moved up out of the cell an enemy stepped straight down into from
+// the bullet's new cell (they passed through each other). A diagonal step
+// never counts, so AI moves can't pair one enemy's departure with
+// another's arrival. Every same-cell hit lands before any crossing, so a
+// stack of enemies goes to the bullet on its cell. Only rows with a hit
+// bit go on to look at entities.
+void bitboard_check_collisions() {
+    unsigned int bullet_rows[HEIGHT] = {0};
+    for (int i = 0; i < MAX_BULLETS; i++) {
+        if (game.bullets[i].active) {
+            bullet_rows[game.bullets[i].y] |= 1u << game.bullets[i].x;
+        }
+    }
+
+    for (int crossing = 0; crossing <= 1; crossing++) {
+        for (int y = 1; y < game.world_height - 1; y++) {
+            unsigned int hits = crossing ? bullet_rows[y] & bullet_from_rows[y + 1] &
+                                           enemy_down_rows[y] & enemy_rows[y + 1]
+                                         : bullet_rows[y] & enemy_rows[y];
+            if (hits == 0) continue;
+
+            // Every enemy on the bullet's cell, as check_collisions does,
+            // or the one enemy it crossed on the row below
+            int target_y = crossing ? y + 1 : y;
+            for (int b = 0; b < MAX_BULLETS; b++) {
+                Bullet* bullet = &game.bullets[b];
+                if (!bullet->active || bullet->y != y || !(hits >> bullet->x & 1)) continue;
+
+                for (int e = 0; e < game.enemy_limit; e++) {
+                    Enemy* enemy = &game.enemies[e];
+                    if (enemy->active && enemy->x == bullet->x && enemy->y == target_y) {
+                        bullet->active = 0;
+                        bitboard_destroy(e);
+                        if (crossing) break;
+                    }
+                }
+
+                // One bullet per cell
+                hits &= ~(1u << bullet->x);
+                bullet_rows[y] &= ~(1u << bullet->x);
+            }
+        }
+    }
+}
+
+// Nanosecond clock for timing steps too short for now_us()
+static long long bench_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// bench subcommand: time check_collisions() against the bitboard version
+// in the same seeded games
+int run_bench(int argc, char* argv[]) {
+    long long iterations = 2000000;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoll(argv[++i]);
+        } else {
+            printf("Usage: tank_game bench [--iterations N]\n");
+            return 1;
+        }
+    }
+    if (iterations < 1) iterations = 1;
+
+    quiet_mode = 1;
+    particles_enabled = 0;
+
+    #define BENCH_GAMES 64
+    long long game_ticks = iterations / BENCH_GAMES > 0 ? iterations / BENCH_GAMES : 1;
+    int enemy_counts[] = { MAX_ENEMIES, 24, MAX_WORLD_ENEMIES };
+
+    // Two clock reads with nothing between them, taken off every tick
+    long long clock_start = bench_now_ns();
+    for (long long i = 0; i < iterations; i++) {
+        bench_now_ns();
+        bench_now_ns();
+    }
+    long long clock_ns = bench_now_ns() - clock_start;
+
+    printf("\n    %sCOLLISION BENCHMARK (%dx%d board, %d bullets, %lld ticks each)%s\n\n",
+           YELLOW, WIDTH, HEIGHT, MAX_BULLETS, iterations, RESET);
+    printf("    %s%8s %14s %14s %9s%s\n", CYAN, "Enemies", "arrays ns", "bitboard ns", "speedup", RESET);
+
+    for (int c = 0; c < (int)(sizeof(enemy_counts) / sizeof(enemy_counts[0])); c++) {
+        long long timings[2];
+        for (int mode = 0; mode < 2; mode++) {
+            // The engines play the same games; only the bitboard one keeps rows
+            bitboard_mode = mode;
+            timings[mode] = 0;
+            for (long long t = 0; t < iterations; t++) {
+                if (t % game_ticks == 0) {
+                    initialize_game_with_seed(12345u + (unsigned int)(t / game_ticks) * 7919u);
+                    game.enemy_limit = enemy_counts[c];
+                }
+
+                // One update_game() tick, with the player firing as often
+                // as it can and never running out of lives
+                game.ticks++;
+                game.player_lives = STARTING_LIVES;
+                game.player_x = 1 + game_rand() % (game.world_width - 2);
+                fire_bullet();
+                if (bitboard_enabled) {
+                    bitboard_begin_tick();
+                }
+                for (int i = 0; i < MAX_BULLETS; i++) {
+                    if (game.bullets[i].active && --game.bullets[i].y <= 0) {
+                        game.bullets[i].active = 0;
+                    }
+                }
+                move_due_enemies();
+
+                // Timed: refilling the board and the collision check
+                long long start = bench_now_ns();
+                int active_count = 0;
+                for (int i = 0; i < game.enemy_limit; i++) {
+                    active_count += game.enemies[i].active;
+                }
+                while (active_count < game.enemy_limit) {
+                    create_enemy();
+                    active_count++;
+                }
+                if (bitboard_enabled) {
+                    bitboard_check_collisions();
+                } else {
+                    check_collisions();
+                }
+                timings[mode] += bench_now_ns() - start;
+            }
+        }
+
+        double array_ns = (double)(timings[0] - clock_ns) / iterations;
+        double bitboard_ns = (double)(timings[1] - clock_ns) / iterations;
+        printf("    %8d %14.1f %14.1f %8.2fx\n", enemy_counts[c], array_ns, bitboard_ns,
+               bitboard_ns > 0 ? array_ns / bitboard_ns : 0.0);
+    }
+    printf("\n    (rows follow the enemies from tick to tick; only spawning and collisions are timed)\n\n");
+
+    bitboard_mode = 0;
+    bitboard_enabled = 0;
+
+    // The AI costs one field update per tick plus one lookup per enemy, so
+    // it is timed well past the world's own enemy cap
+    #define BENCH_FLOW_ENEMIES 5000
+    #define BENCH_FLOW_TICKS 2000
+    static int flow_enemy_x[BENCH_FLOW_ENEMIES], flow_enemy_y[BENCH_FLOW_ENEMIES];
+    int flow_counts[] = { MAX_WORLD_ENEMIES, 1000, BENCH_FLOW_ENEMIES };
+    int saved_large_map = large_map_mode;
+    large_map_mode = 1;
+
+    printf("    %sFLOW FIELD BENCHMARK (%dx%d world, %d ticks each, %d ms per tick)%s\n\n",
+           YELLOW, WORLD_WIDTH, WORLD_HEIGHT, BENCH_FLOW_TICKS, TICK_MS, RESET);
+    printf("    %s%8s %14s %14s %14s%s\n", CYAN, "Enemies", "field us", "enemies us", "ns/enemy", RESET);
+
+    for (int c = 0; c < (int)(sizeof(flow_counts) / sizeof(flow_counts[0])); c++) {
+        int count = flow_counts[c];
+        initialize_game_with_seed(4242u);
+        flow_world_width = 0;  // start from a cold field
+        int w = game.world_width, h = game.world_height;
+        for (int i = 0; i < count; i++) {
+            flow_enemy_x[i] = 1 + game_rand() % (w - 2);
+            flow_enemy_y[i] = 1 + game_rand() % (h - 2);
+        }
+
+        long long field_us = 0, enemy_us = 0;
+        for (int t = 0; t < BENCH_FLOW_TICKS; t++) {
+            // The player dodges every few ticks and keeps every bullet in flight
+            if (t % 8 == 0) {
+                game.player_x = 1 + game_rand() % (w - 2);
+            }
+            for (int i = 0; i < MAX_BULLETS; i++) {
+                Bullet* bullet = &game.bullets[i];
+                if (!bullet->active || bullet->y <= 1) {
+                    bullet->active = 1;
+                    bullet->x = game.player_x;
+                    bullet->y = game.player_y - 1;
+                } else {
+                    bullet->y--;
+                }
+            }
+
+            long long start = now_us();
+            update_flow_field();
+            long long middle = now_us();
+            for (int i = 0; i < count; i++) {
+                flow_enemy_x[i] = flow_next_x[flow_enemy_y[i]][flow_enemy_x[i]];
+                if (++flow_enemy_y[i] >= h - 1) {
+                    flow_enemy_y[i] = 1;
+                }
+            }
+            enemy_us += now_us() - middle;
+            field_us += middle - start;
+        }
+
+        printf("    %8d %14.1f %14.1f %14.2f\n", count,
+               (double)field_us / BENCH_FLOW_TICKS, (double)enemy_us / BENCH_FLOW_TICKS,
+               enemy_us * 1000.0 / ((double)BENCH_FLOW_TICKS * count));
+    }
+    printf("\n    (figures are per tick; the player moves every 8th tick, forcing a full field pass)\n\n");
+
+    large_map_mode = saved_large_map;
+    return 0;
+}
+
+// Bring the flow field up to date. Enemies only ever move down (straight
+// or diagonally), so distances are filled one row at a time from the bottom
+// and a change at (x, y) can only reach columns x - 1 .. x + 1 of the row
+// above. Each row redoes just the cells under a changed neighbour or whose
+// own cost changed, and the pass stops once a row changes nothing and no
+// lane change lies further up.
+void update_flow_field() {
+    // Lowest row in each column that a rising bullet will still pass through
+    int lane_bottom[WORLD_WIDTH] = {0};
+    for (int i = 0; i < MAX_BULLETS; i++) {
+        if (game.bullets[i].active && game.bullets[i].y > lane_bottom[game.bullets[i].x]) {
+            lane_bottom[game.bullets[i].x] = game.bullets[i].y;
+        }
+    }
+
+    int w = game.world_width;
+    int bottom = game.world_height - 1;
+
+    // A new world size leaves nothing worth comparing against
+    int full = flow_world_width != w || flow_world_height != game.world_height;
+    flow_world_width = w;
+    flow_world_height = game.world_height;
+
+    // Columns of the row below whose distance changed
+    int changed_lo = w, changed_hi = -1;
+
+    // The goal row just below the board pulls enemies toward the player
+    if (full || flow_player_x != game.player_x) {
+        flow_player_x = game.player_x;
+        for (int x = 0; x < w; x++) {
+            flow_distance[bottom][x] = abs(x - game.player_x);
+        }
+        changed_lo = 0;
+        changed_hi = w - 1;
+    }
+
+    // A lane that grew or shrank changes the danger cost of the rows
+    // between its old and new bottom. Only columns that held a bullet
+    // before or hold one now can differ, so there are few of them.
+    int lane_x[2 * MAX_BULLETS], lane_top[2 * MAX_BULLETS], lane_end[2 * MAX_BULLETS];
+    int lanes = 0;
+    int highest_lane = bottom;
+    for (int x = 0; x < w; x++) {
+        if (lane_bottom[x] == flow_lane_bottom[x]) continue;
+        if (lanes < 2 * MAX_BULLETS) {
+            int low = min(lane_bottom[x], flow_lane_bottom[x]);
+            lane_x[lanes] = x;
+            lane_top[lanes] = low + 1;
+            lane_end[lanes] = lane_bottom[x] + flow_lane_bottom[x] - low;
+            if (lane_top[lanes] < highest_lane) highest_lane = lane_top[lanes];
+            lanes++;
+        } else {
+            full = 1;  // only a thread switching between worlds gets here
+        }
+        flow_lane_bottom[x] = lane_bottom[x];
+    }
+
+    // A new goal row changes every row above it, so skip the bookkeeping
+    int whole = full || changed_hi == w - 1;
+
+    // Thread-local addresses are not free in the shared library build, so
+    // look them up once rather than on every cell
+    int (*distance)[WORLD_WIDTH] = flow_distance;
+    unsigned char (*next_x)[WORLD_WIDTH] = flow_next_x;
+
+    for (int y = bottom - 1; y >= 1; y--) {
+        int from = changed_lo - 1, to = changed_hi + 1;
+        for (int i = 0; i < lanes; i++) {
+            if (y >= lane_top[i] && y <= lane_end[i]) {
+                if (lane_x[i] < from) from = lane_x[i];
+                if (lane_x[i] > to) to = lane_x[i];
+            }
+        }
+        if (whole) {
+            from = 1;
+            to = w - 2;
+        }
+        if (from < 1) from = 1;
+        if (to > w - 2) to = w - 2;
+
+        changed_lo = w;
+        changed_hi = -1;
+        if (from > to) {
+            if (y <= highest_lane) break;
+            continue;
+        }
+
+        for (int x = from; x <= to; x++) {
+            // Prefer straight down on ties, then left, then right
+            int best_x = x;
+            int best = distance[y + 1][x];
+            if (x > 1 && distance[y + 1][x - 1] < best) {
+                best = distance[y + 1][x - 1];
+                best_x = x - 1;
+            }
+            if (x < w - 2 && distance[y + 1][x + 1] < best) {
+                best = distance[y + 1][x + 1];
+                best_x = x + 1;
+            }
+
+            int cost = 1;
+            if (y <= lane_bottom[x]) {
+                cost += FLOW_DANGER_COST;
+            }
+
+            if (!whole && distance[y][x] != best + cost) {
+                if (x < changed_lo) changed_lo = x;
+                changed_hi = x;
+            }
+            distance[y][x] = best + cost;
+            next_x[y][x] = (unsigned char)best_x;
+        }
+    }
+}
+
+// Map the shared leaderboard, creating it from the local scores if needed
+int open_shared_board() {
+    int fd = open(SHARED_SCORE_FILE, O_CREAT | O_RDWR, 0666);
+    if (fd < 0) {
+        return 0;
+    }
+
+    // Only held while the file is being set up, never during play
+    flock(fd, LOCK_EX);
+
+    struct stat info;
+    int fresh = fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(SharedBoard);
+    if (fresh && ftruncate(fd, sizeof(SharedBoard)) != 0) {
+        flock(fd, LOCK_UN);
+        close(fd);
+        return 0;
+    }
+
+    void* memory = mmap(NULL, sizeof(SharedBoard), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        flock(fd, LOCK_UN);
+        close(fd);
+        return 0;
+    }
+
+    SharedBoard* board_file = (SharedBoard*)memory;
+    if (board_file->magic != SHARED_SCORE_MAGIC) {
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&board_file->lock, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+
+        // Start empty; the background loader seeds it from the text file
+        board_file->count = 0;
+        atomic_store(&board_file->sequence, 2);
+        board_file->magic = SHARED_SCORE_MAGIC;
+        msync(memory, sizeof(SharedBoard), MS_SYNC);
+        shared_board_seeding = 1;
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    shared_board = board_file;
+    shared_board_seen = 0;
+    shared_board_sync();
+    return 1;
+}
+
+// The board's lock can't be taken any more (ENOTRECOVERABLE or worse), so
+// writing it would race other games. Keep what was last synced as a local
+// list that save_high_scores() writes to the text file from now on.
+static void shared_board_detach(int error) {
+    printf("    %sShared leaderboard unusable (%s), keeping scores in %s%s\n",
+           RED, strerror(error), HIGH_SCORE_FILE, RESET);
+    munmap(shared_board, sizeof(SharedBoard));
+    shared_board = NULL;
+}
+
+// Post a score to the shared leaderboard (keeps one best entry per name).
+// Returns 0 if the board had to be given up instead.
+int shared_board_add(const char* name, int score) {
+    SharedBoard* b = shared_board;
+
+    int locked = pthread_mutex_lock(&b->lock);
+    if (locked == EOWNERDEAD) {
+        // A game died while holding the lock; the repair below makes it usable
+        pthread_mutex_consistent(&b->lock);
+    } else if (locked != 0) {
+        shared_board_detach(locked);
+        return 0;
+    }
+
+    // An odd sequence left behind by a dead writer is rounded up
+    unsigned int sequence = atomic_load_explicit(&b->sequence, memory_order_relaxed);
+    sequence = (sequence + 1) & ~1u;
+    atomic_store_explicit(&b->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    if (b->count < 0 || b->count > MAX_HIGH_SCORES) {
+        b->count = b->count < 0 ? 0 : MAX_HIGH_SCORES;
+    }
+
+    // Find the player's entry, or the slot a new entry would take
+    int position = -1;
+    for (int i = 0; i < b->count; i++) {
+        if (strncmp(b->entries[i].name, name, MAX_PLAYER_NAME) == 0) {
+            position = i;
+            break;
+        }
+    }
+
+    if (position >= 0) {
+        if (score <= b->entries[position].score) {
+            position = -1;  // existing best is already higher
+        }
+    } else if (b->count < MAX_HIGH_SCORES) {
+        position = b->count++;
+        strncpy(b->entries[position].name, name, MAX_PLAYER_NAME - 1);
+        b->entries[position].name[MAX_PLAYER_NAME - 1] = '\0';
+    } else if (score > b->entries[b->count - 1].score) {
+        position = b->count - 1;  // bump the lowest score off the board
+        strncpy(b->entries[position].name, name, MAX_PLAYER_NAME - 1);
+        b->entries[position].name[MAX_PLAYER_NAME - 1] = '\0';
+    }
+
+    if (position >= 0) {
+        b->entries[position].score = score;
+
+        // Move the entry up until the board is sorted again
+        while (position > 0 && b->entries[position - 1].score < b->entries[position].score) {
+            SharedScore temp = b->entries[position - 1];
+            b->entries[position - 1] = b->entries[position];
+            b->entries[position] = temp;
+            position--;
+        }
+    }
+
+    atomic_store_explicit(&b->sequence, sequence + 2, memory_order_release);
+    pthread_mutex_unlock(&b->lock);
+    return 1;
+}
+
+// Copy the shared leaderboard into the linked list if it has changed
+void shared_board_sync() {
+    if (shared_board == NULL) return;
+
+    SharedScore entries[MAX_HIGH_SCORES];
+    int count;
+    unsigned int before;
+    int waits = 0;
+
+    while (1) {
+        before = atomic_load_explicit(&shared_board->sequence, memory_order_acquire);
+        if (before == shared_board_seen) {
+            return;  // nothing new since last time
+        }
+        if (before & 1) {
+            // A writer is mid-update. One that died there leaves the
+            // sequence odd for good, so don't wait on it forever.
+            if (++waits < SHARED_SYNC_SPINS) {
+                sched_yield();
+                continue;
+            }
+
+            int locked = pthread_mutex_trylock(&shared_board->lock);
+            if (locked == EOWNERDEAD) {
+                pthread_mutex_consistent(&shared_board->lock);
+                locked = 0;
+            }
+            if (locked == EBUSY) {
+                return;  // a live writer is slow; keep the list we have
+            }
+            if (locked != 0) {
+                shared_board_detach(locked);
+                return;
+            }
+
+            // Round the sequence up as shared_board_add() does
+            unsigned int sequence = atomic_load_explicit(&shared_board->sequence, memory_order_relaxed);
+            if (sequence & 1) {
+                atomic_store_explicit(&shared_board->sequence, sequence + 1, memory_order_release);
+            }
+            pthread_mutex_unlock(&shared_board->lock);
+            waits = 0;
+            continue;
+        }
+
+        count = shared_board->count;
+        memcpy(entries, shared_board->entries, sizeof(entries));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shared_board->sequence, memory_order_relaxed) == before) {
+            break;
+        }
+    }
+
+    if (count < 0) count = 0;
+    if (count > MAX_HIGH_SCORES) count = MAX_HIGH_SCORES;
+
+    // Rebuild the list in board order (already sorted)
+    free_score_list();
+    ScoreNode* tail = NULL;
+    for (int i = 0; i < count; i++) {
+        entries[i].name[MAX_PLAYER_NAME - 1] = '\0';
+        prefix_index_add(entries[i].name, (int)strlen(entries[i].name), entries[i].score);
+        ScoreNode* new_node = create_score_node(entries[i].name, entries[i].score);
+        if (!new_node) continue;
+
+        if (tail == NULL) {
+            high_score_list = new_node;
+        } else {
+            tail->next = new_node;
+        }
+        tail = new_node;
+        num_high_scores++;
+    }
+
+    shared_board_seen = before;
+}
+
+// Monotonic clock in microseconds
+long long now_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Count one observation in a histogram
+void observe(Histogram* histogram, long long microseconds) {
+    int bucket = 0;
+    while (bucket < METRIC_BUCKETS && microseconds > metric_bounds_us[bucket]) {
+        bucket++;
+    }
+
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_us, microseconds > 0 ? microseconds : 0, memory_order_relaxed);
+}
+
+// Copy the live entity counts where the metrics thread can read them
+void publish_gauges() {
+    int enemies = 0, bullets = 0;
+    for (int i = 0; i < game.enemy_limit; i++) {
+        enemies += game.enemies[i].active;
+    }
+    for (int i = 0; i < MAX_BULLETS; i++) {
+        bullets += game.bullets[i].active;
+    }
+
+    atomic_store_explicit(&metric_enemies, enemies, memory_order_relaxed);
+    atomic_store_explicit(&metric_bullets, bullets, memory_order_relaxed);
+    atomic_store_explicit(&metric_particles, particle_count, memory_order_relaxed);
+    atomic_store_explicit(&metric_high_scores, num_high_scores, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metric_frames, 1, memory_order_relaxed);
+}
+
+// A TCP port number, or 0 if the text is not one
+int parse_port(const char* text) {
+    char* end;
+    errno = 0;
+    long port = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || port < 1 || port > 65535) {
+        return 0;
+    }
+    return (int)port;
+}
+
+// Listen on a loopback port ("9100") or a UNIX socket ("unix:/path") and
+// serve scrapes from a thread of their own
+int start_metrics(const char* address) {
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un local;
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        snprintf(local.sun_path, sizeof(local.sun_path), "%s", address + 5);
+        unlink(local.sun_path);
+
+        metrics_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (metrics_fd < 0 || bind(metrics_fd, (struct sockaddr*)&local, sizeof(local)) != 0) {
+            if (metrics_fd >= 0) close(metrics_fd);
+            metrics_fd = -1;
+            return 0;
+        }
+    } else {
+        int port = parse_port(address);
+        if (port == 0) {
+            return 0;
+        }
+
+        struct sockaddr_in loopback;
+        memset(&loopback, 0, sizeof(loopback));
+        loopback.sin_family = AF_INET;
+        loopback.sin_port = htons((unsigned short)port);
+        loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int reuse = 1;
+        metrics_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (metrics_fd >= 0) {
+            setsockopt(metrics_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        }
+        if (metrics_fd < 0 || bind(metrics_fd, (struct sockaddr*)&loopback, sizeof(loopback)) != 0) {
+            if (metrics_fd >= 0) close(metrics_fd);
+            metrics_fd = -1;
+            return 0;
+        }
+    }
+
+    if (listen(metrics_fd, 8) != 0 || pthread_create(&metrics_thread, NULL, metrics_main, NULL) != 0) {
+        close(metrics_fd);
+        metrics_fd = -1;
+        return 0;
+    }
+    pthread_detach(metrics_thread);
+    return 1;
+}
+
+// Append one histogram in Prometheus text format
+static int write_histogram(char* out, int space, Histogram* histogram) {
+    int length = snprintf(out, space, "# HELP %s %s\n# TYPE %s histogram\n",
+                          histogram->name, histogram->help, histogram->name);
+
+    unsigned long cumulative = 0;
+    for (int i = 0; i <= METRIC_BUCKETS && length < space; i++) {
+        cumulative += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (i < METRIC_BUCKETS) {
+            length += snprintf(out + length, space - length, "%s_bucket{le=\"%g\"} %lu\n",
+                               histogram->name, metric_bounds_us[i] / 1e6, cumulative);
+        } else {
+            length += snprintf(out + length, space - length, "%s_bucket{le=\"+Inf\"} %lu\n",
+                               histogram->name, cumulative);
+        }
+    }
+
+    if (length < space) {
+        length += snprintf(out + length, space - length, "%s_sum %.6f\n%s_count %lu\n",
+                           histogram->name,
+                           atomic_load_explicit(&histogram->sum_us, memory_order_relaxed) / 1e6,
+                           histogram->name,
+                           atomic_load_explicit(&histogram->count, memory_order_relaxed));
+    }
+    return length < space ? length : space;
+}
+
+// Metrics thread: answer every connection with the current values
+void* metrics_main(void* unused) {
+    (void)unused;
+    static char body[16384];
+    static char response[17000];
+
+    while (1) {
+        int client = accept(metrics_fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // A client that connects and never sends (or never reads) must not
+        // hold up the scrapes behind it
+        struct timeval timeout = { METRICS_TIMEOUT_MS / 1000, (METRICS_TIMEOUT_MS % 1000) * 1000 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        // The request itself does not matter, every path gets the metrics
+        char request[1024];
+        recv(client, request, sizeof(request), 0);
+
+        int length = 0;
+        int space = sizeof(body);
+        length += write_histogram(body + length, space - length, &frame_histogram);
+        length += write_histogram(body + length, space - length, &tick_histogram);
+        length += write_histogram(body + length, space - length, &input_histogram);
+        length += write_histogram(body + length, space - length, &save_histogram);
+        length += write_histogram(body + length, space - length, &load_histogram);
+
+        unsigned long queued = atomic_load(&record_head) - atomic_load(&record_tail);
+        pthread_mutex_lock(&score_queue_lock);
+        int scores_queued = score_queue_count;
+        pthread_mutex_unlock(&score_queue_lock);
+        length += snprintf(body + length, space - length,
+            "# HELP tank_active_enemies Enemies on the board\n# TYPE tank_active_enemies gauge\n"
+            "tank_active_enemies %d\n"
+            "# HELP tank_active_bullets Bullets in flight\n# TYPE tank_active_bullets gauge\n"
+            "tank_active_bullets %d\n"
+            "# HELP tank_active_particles Live effect particles\n# TYPE tank_active_particles gauge\n"
+            "tank_active_particles %d\n"
+            "# HELP tank_leaderboard_entries Entries on the high score list\n# TYPE tank_leaderboard_entries gauge\n"
+            "tank_leaderboard_entries %d\n"
+            "# HELP tank_record_queue_bytes Recorded frames waiting to be written\n# TYPE tank_record_queue_bytes gauge\n"
+            "tank_record_queue_bytes %lu\n"
+            "# HELP tank_record_dropped_frames_total Frames dropped because the record queue was full\n"
+            "# TYPE tank_record_dropped_frames_total counter\n"
+            "tank_record_dropped_frames_total %lu\n"
+            "# HELP tank_score_queue_games Finished server games waiting for the score writer\n"
+            "# TYPE tank_score_queue_games gauge\n"
+            "tank_score_queue_games %d\n"
+            "# HELP tank_score_dropped_games_total Finished games dropped because the score queue was full\n"
+            "# TYPE tank_score_dropped_games_total counter\n"
+            "tank_score_dropped_games_total %lu\n"
+            "# HELP tank_frames_total Frames rendered\n# TYPE tank_frames_total counter\n"
+            "tank_frames_total %lu\n"
+            "# HELP tank_games_total Games started\n# TYPE tank_games_total counter\n"
+            "tank_games_total %lu\n"
+            "# HELP tank_time_to_first_frame_seconds Time from startup to the first screen\n"
+            "# TYPE tank_time_to_first_frame_seconds gauge\n"
+            "tank_time_to_first_frame_seconds %.6f\n",
+            atomic_load_explicit(&metric_enemies, memory_order_relaxed),
+            atomic_load_explicit(&metric_bullets, memory_order_relaxed),
+            atomic_load_explicit(&metric_particles, memory_order_relaxed),
+            atomic_load_explicit(&metric_high_scores, memory_order_relaxed),
+            queued,
+            atomic_load_explicit(&record_dropped, memory_order_relaxed),
+            scores_queued,
+            atomic_load_explicit(&score_queue_dropped, memory_order_relaxed),
+            atomic_load_explicit(&metric_frames, memory_order_relaxed),
+            atomic_load_explicit(&metric_games, memory_order_relaxed),
+            atomic_load_explicit(&time_to_first_frame_us, memory_order_relaxed) / 1e6);
+        if (length > space) length = space;
+
+        int header = snprintf(response, sizeof(response),
+                              "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                              "Content-Length: %d\r\nConnection: close\r\n\r\n", length);
+        memcpy(response + header, body, length);
+        send(client, response, header + length, MSG_NOSIGNAL);
+        close(client);
+    }
+    return NULL;
+}
+
+// Take a particle from the pool (dropped if the pool is full or the last
+// frame went over budget and the particle is only decoration)
+void spawn_particle(int x, int y, int vx, int vy, int life, char glyph, int low_priority) {
+    if (!particles_enabled || particle_count >= MAX_PARTICLES) return;
+    if (low_priority && frame_stats.over_budget) return;
+
+    int i = particle_count++;
+    particle_x[i] = x * 16 + 8;
+    particle_y[i] = y * 16 + 8;
+    particle_vx[i] = (signed char)vx;
+    particle_vy[i] = (signed char)vy;
+    particle_age[i] = 0;
+    particle_life[i] = (unsigned char)life;
+    particle_glyph[i] = glyph;
+    particle_low_priority[i] = (unsigned char)low_priority;
+}
+
+// Burst of debris where an enemy was destroyed
+void spawn_explosion(int x, int y) {
+    spawn_particle(x, y, 0, 0, 2, 'x', 0);
+
+    for (int i = 0; i < 8; i++) {
+        particle_rng ^= particle_rng << 13;
+        particle_rng ^= particle_rng >> 17;
+        particle_rng ^= particle_rng << 5;
+
+        int vx = (int)(particle_rng & 31) - 16;
+        int vy = (int)((particle_rng >> 5) & 31) - 16;
+        int life = 2 + (int)((particle_rng >> 10) & 3);
+        spawn_particle(x, y, vx, vy, life, i < 4 ? 'o' : '.', i >= 4);
+    }
+}
+
+// Short flash in front of the tank when it fires
+void spawn_muzzle_flash(int x, int y) {
+    spawn_particle(x - 1, y, 0, 0, 1, '\'', 1);
+    spawn_particle(x + 1, y, 0, 0, 1, '\'', 1);
+}
+
+// Age and move every particle in one pass, dropping the dead ones
+void update_particles() {
+    int shed = frame_stats.over_budget;
+
+    int i = 0;
+    while (i < particle_count) {
+        particle_age[i]++;
+        if (particle_age[i] >= particle_life[i] || (shed && particle_low_priority[i])) {
+            // Fill the hole with the last live particle
+            particle_count--;
+            particle_x[i] = particle_x[particle_count];
+            particle_y[i] = particle_y[particle_count];
+            particle_vx[i] = particle_vx[particle_count];
+            particle_vy[i] = particle_vy[particle_count];
+            particle_age[i] = particle_age[particle_count];
+            particle_life[i] = particle_life[particle_count];
+            particle_glyph[i] = particle_glyph[particle_count];
+            particle_low_priority[i] = particle_low_priority[particle_count];
+            continue;
+        }
+
+        particle_x[i] += particle_vx[i];
+        particle_y[i] += particle_vy[i];
+        i++;
+    }
+}
+
+// Composite particles into the view, leaving walls and entities visible
+void draw_particles(int view_w, int view_h) {
+    for (int i = 0; i < particle_count; i++) {
+        int x = (particle_x[i] >> 4) - camera_x;
+        int y = (particle_y[i] >> 4) - camera_y;
+        if (x >= 0 && x < view_w && y >= 0 && y < view_h && view[y][x] == ' ') {
+            view[y][x] = particle_glyph[i];
+        }
+    }
+}
+
+// Rebuild the spatial index. Only cells used last time are cleared, so
+// the cost follows the number of entities rather than the world size.
+void index_entities() {
+    for (int id = 0; id < GRID_ENTITIES; id++) {
+        if (grid_cell_of[id] >= 0) {
+            grid_head[grid_cell_of[id] / GRID_COLUMNS][grid_cell_of[id] % GRID_COLUMNS] = -1;
+            grid_cell_of[id] = -1;
+        }
+    }
+
+    for (int id = 0; id < MAX_BULLETS + game.enemy_limit; id++) {
+        int x, y;
+        if (id < MAX_BULLETS) {
+            if (!game.bullets[id].active) continue;
+            x = game.bullets[id].x;
+            y = game.bullets[id].y;
+        } else {
+            if (!game.enemies[id - MAX_BULLETS].active) continue;
+            x = game.enemies[id - MAX_BULLETS].x;
+            y = game.enemies[id - MAX_BULLETS].y;
+        }
+
+        int row = y / GRID_CELL, column = x / GRID_CELL;
+        if (row >= 0 && row < GRID_ROWS && column >= 0 && column < GRID_COLUMNS) {
+            grid_next[id] = grid_head[row][column];
+            grid_head[row][column] = id;
+            grid_cell_of[id] = row * GRID_COLUMNS + column;
+        }
+    }
+}
+
+// Switch this thread to another game. The spatial index and bitboards
+// still describe whichever game ran last, so they are rebuilt. The flow
+// field is kept: update_flow_field() already compares the player column,
+// world size and bullet lanes it was built for, and redoes only the rows
+// that differ.
+void restore_game_state(const GameState* state) {
+    memcpy(&game, state, sizeof(GameState));
+    index_entities();
+    bitboard_rebuild();
+}
+
+// Fit the view to the terminal, but never smaller than the classic board
+void update_view_size() {
+    terminal_resized = 0;
+
+    struct winsize size;
+    int columns = 80, rows = 24;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+        columns = size.ws_col;
+        rows = size.ws_row;
+    }
+
+    // Leave room for the left margin and the status lines under the board
+    view_width = min(WORLD_WIDTH, columns - 8);
+    view_height = min(WORLD_HEIGHT, rows - 7);
+    if (view_width < WIDTH) view_width = WIDTH;
+    if (view_height < HEIGHT) view_height = HEIGHT;
+}
+
+// SIGWINCH handler: pick up the new size on the next frame
+void handle_resize(int signal_number) {
+    (void)signal_number;
+    terminal_resized = 1;
+}
+
+// Invariants the fuzzer checks after every step
+enum {
+    FUZZ_OK,
+    FUZZ_BOUNDS,       // everything inside the world
+    FUZZ_OVERLAP,      // enemies stacked on a cell are all counted (bitboard)
+    FUZZ_TUNNEL,       // a bullet and an enemy never swap cells unharmed (bitboard)
+    FUZZ_COUNTS,       // enemy, bullet, score and lives bookkeeping
+    FUZZ_WHEEL,        // every enemy is scheduled exactly once
+    FUZZ_EFFECTS,      // a muzzle flash shows in the frame after it is fired
+    FUZZ_ENGINES,      // bitboard collisions match the array check plus swaps
+    FUZZ_LEADERBOARD,  // list sorted, unique, capped, and num_high_scores matches
+    FUZZ_CHECKS
+};
+
+const char* fuzz_check_names[FUZZ_CHECKS] = {
+    "ok", "bounds", "overlap", "tunnel", "counts", "wheel", "effects", "engines", "leaderboard"
+};
+
+// Game inputs, written in the input log as one letter each
+enum { FUZZ_IDLE, FUZZ_LEFT, FUZZ_RIGHT, FUZZ_FIRE, FUZZ_UP, FUZZ_DOWN, FUZZ_ACTIONS };
+const char fuzz_action_letters[FUZZ_ACTIONS + 1] = ".LRFUD";
+
+int fuzz_skip[FUZZ_CHECKS];
+char fuzz_detail[160];
+GameState fuzz_before;
+
+// Check the game state after a step against the state before it
+static int check_game_invariants(const GameState* before) {
+    int w = game.world_width, h = game.world_height;
+
+    if (!fuzz_skip[FUZZ_BOUNDS]) {
+        if (game.player_x < 1 || game.player_x > w - 2 || game.player_y < 1 || game.player_y > h - 2) {
+            snprintf(fuzz_detail, sizeof(fuzz_detail), "player at (%d,%d)", game.player_x, game.player_y);
+            return FUZZ_BOUNDS;
+        }
+        for (int i = 0; i < MAX_BULLETS; i++) {
+            const Bullet* b = &game.bullets[i];
+            if (b->active && (b->x < 1 || b->x > w - 2 || b->y < 1 || b->y > h - 2)) {
+                snprintf(fuzz_detail, sizeof(fuzz_detail), "bullet %d at (%d,%d)", i, b->x, b->y);
+                return FUZZ_BOUNDS;
+            }
+        }
+        for (int i = 0; i < game.enemy_limit; i++) {
+            const Enemy* e = &game.enemies[i];
+            if (e->active && (e->x < 1 || e->x > w - 2 || e->y < 1 || e->y > h - 2)) {
+                snprintf(fuzz_detail, sizeof(fuzz_detail), "enemy %d at (%d,%d)", i, e->x, e->y);
+                return FUZZ_BOUNDS;
+            }
+        }
+    }
+
+    // Enemies may stack: steps never look for a free cell and spawns only
+    // try to. A stack must then be counted whole, or a hit on it would
+    // leave its row bit behind.
+    if (!fuzz_skip[FUZZ_OVERLAP] && bitboard_enabled) {
+        unsigned char counts[HEIGHT][BITBOARD_MAX_WIDTH] = {{0}};
+        for (int i = 0; i < game.enemy_limit; i++) {
+            if (game.enemies[i].active) {
+                counts[game.enemies[i].y][game.enemies[i].x]++;
+            }
+        }
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                if (counts[y][x] != enemy_cell_count[y][x]) {
+                    snprintf(fuzz_detail, sizeof(fuzz_detail), "%d enemies at (%d,%d), bitboard counts %d",
+                             counts[y][x], x, y, enemy_cell_count[y][x]);
+                    return FUZZ_OVERLAP;
+                }
+            }
+        }
+    }
+
+    // The array engine keeps the original game's pass-through; only the
+    // bitboard engine promises a bullet never slips past an enemy
+    if (!fuzz_skip[FUZZ_TUNNEL] && bitboard_enabled) {
+        for (int b = 0; b < MAX_BULLETS; b++) {
+            const Bullet* now_b = &game.bullets[b];
+            const Bullet* was_b = &before->bullets[b];
+            if (!now_b->active || !was_b->active || now_b->x != was_b->x || now_b->y != was_b->y - 1) continue;
+
+            for (int e = 0; e < game.enemy_limit; e++) {
+                const Enemy* now_e = &game.enemies[e];
+                const Enemy* was_e = &before->enemies[e];
+                if (now_e->active && was_e->active &&
+                    was_e->x == now_b->x && was_e->y == now_b->y &&
+                    now_e->x == was_b->x && now_e->y == was_b->y) {
+                    snprintf(fuzz_detail, sizeof(fuzz_detail),
+                             "bullet %d and enemy %d passed through each other at column %d", b, e, now_b->x);
+                    return FUZZ_TUNNEL;
+                }
+            }
+        }
+    }
+
+    if (!fuzz_skip[FUZZ_COUNTS]) {
+        int enemies = 0;
+        for (int i = 0; i < MAX_WORLD_ENEMIES; i++) {
+            if (game.enemies[i].active) {
+                if (i >= game.enemy_limit) {
+                    snprintf(fuzz_detail, sizeof(fuzz_detail), "enemy %d active beyond limit %d", i, game.enemy_limit);
+                    return FUZZ_COUNTS;
+                }
+                enemies++;
+            }
+        }
+        if (enemies != game.enemy_limit) {
+            snprintf(fuzz_detail, sizeof(fuzz_detail), "%d enemies active, expected %d", enemies, game.enemy_limit);
+            return FUZZ_COUNTS;
+        }
+        if (game.score != game.hits || game.hits > game.shots_fired) {
+            snprintf(fuzz_detail, sizeof(fuzz_detail), "score %d, hits %d, shots %d",
+                     game.score, game.hits, game.shots_fired);
+            return FUZZ_COUNTS;
+        }
+        if (game.player_lives > before->player_lives || game.player_lives > STARTING_LIVES) {
+            snprintf(fuzz_detail, sizeof(fuzz_detail), "lives went from %d to %d",
+                     before->player_lives, game.player_lives);
+            return FUZZ_COUNTS;
+        }
+        if (bitboard_enabled) {
+            // The row words must describe exactly the active enemies
+            unsigned int rows[HEIGHT] = {0};
+            for (int i = 0; i < game.enemy_limit; i++) {
+                if (game.enemies[i].active) {
+                    rows[game.enemies[i].y] |= 1u << game.enemies[i].x;
+                }
+            }
+            for (int y = 0; y < game.world_height; y++) {
+                if (rows[y] != enemy_rows[y]) {
+                    snprintf(fuzz_detail, sizeof(fuzz_detail), "bitboard row %d is %08x, enemies give %08x",
+                             y, enemy_rows[y], rows[y]);
+                    return FUZZ_COUNTS;
+                }
+            }
+        }
+    }
+
+    if (!fuzz_skip[FUZZ_WHEEL]) {
+        int scheduled = 0;
+        for (int bucket = 0; bucket < WHEEL_BUCKETS; bucket++) {
+            int previous = -1;
+            for (int i = game.wheel_heads[bucket]; i >= 0; i = game.enemies[i].wheel_next) {
+                const Enemy* e = &game.enemies[i];
+                if (!e->active || e->wheel_bucket != bucket || e->wheel_prev != previous ||
+                    e->next_move <= game.ticks || ++scheduled > game.enemy_limit) {
+                    snprintf(fuzz_detail, sizeof(fuzz_detail), "enemy %d badly scheduled in bucket %d", i, bucket);
+                    return FUZZ_WHEEL;
+                }
+                previous = i;
+            }
+        }
+        for (int i = 0; i < game.enemy_limit; i++) {
+            if (game.enemies[i].active && game.enemies[i].wheel_bucket < 0) {
+                snprintf(fuzz_detail, sizeof(fuzz_detail), "enemy %d is never going to move", i);
+                return FUZZ_WHEEL;
+            }
+        }
+    }
+
+    return FUZZ_OK;
+}
+
+// Check the high score list after an add
+static int check_leaderboard_invariants() {
+    int length = 0;
+    for (ScoreNode* current = high_score_list; current != NULL; current = current->next) {
+        length++;
+        if (current->next != NULL && current->next->score > current->score) {
+            snprintf(fuzz_detail, sizeof(fuzz_detail), "%s (%d) listed above %s (%d)",
+                     current->name, current->score, current->next->name, current->next->score);
+            return FUZZ_LEADERBOARD;
+        }
+        for (ScoreNode* other = current->next; other != NULL; other = other->next) {
+            if (strcmp(other->name, current->name) == 0) {
+                snprintf(fuzz_detail, sizeof(fuzz_detail), "%s listed twice", current->name);
+                return FUZZ_LEADERBOARD;
+            }
+        }
+    }
+
+    if (length != num_high_scores || length > MAX_HIGH_SCORES) {
+        snprintf(fuzz_detail, sizeof(fuzz_detail), "list has %d entries, num_high_scores is %d (max %d)",
+                 length, num_high_scores, MAX_HIGH_SCORES);
+        return FUZZ_LEADERBOARD;
+    }
+    return FUZZ_OK;
+}
+
+// Compose the frame that follows a shot the way render_game() does, and
+// check both halves of the muzzle flash made it onto empty cells
+static int check_muzzle_flash(int x, int y) {
+    int view_w, view_h;
+    compose_frame(&view_w, &view_h);
+
+    for (int side = -1; side <= 1; side += 2) {
+        int view_x = x + side - camera_x, view_y = y - camera_y;
+        if (view_x >= 0 && view_x < view_w && view_y >= 0 && view_y < view_h && view[view_y][view_x] == ' ') {
+            snprintf(fuzz_detail, sizeof(fuzz_detail), "muzzle flash at (%d,%d) not drawn", x + side, y);
+            return FUZZ_EFFECTS;
+        }
+    }
+    return FUZZ_OK;
+}
+
+// Replay one game input log from a seed; returns the broken invariant
+// (or FUZZ_OK) and the step it broke at
+static int replay_game(unsigned int seed, const unsigned char* actions, int length, int* failed_step) {
+    initialize_game_with_seed(seed);
+
+    for (int step = 0; step < length; step++) {
+        int particles_before = particle_count;
+        switch (actions[step]) {
+            case FUZZ_LEFT:  move_player('a'); break;
+            case FUZZ_RIGHT: move_player('d'); break;
+            case FUZZ_FIRE:  fire_bullet(); break;
+            case FUZZ_UP:    move_player('w'); break;
+            case FUZZ_DOWN:  move_player('x'); break;
+        }
+        int flashed = actions[step] == FUZZ_FIRE && particle_count > particles_before;
+        int flash_x = game.player_x, flash_y = game.player_y - 1;
+
+        memcpy(&fuzz_before, &game, sizeof(GameState));
+        update_game();
+
+        // Only a shot needs the frame; other steps just age the effects
+        // as rendering would, so the pool fills and drains as in play
+        int broken = check_game_invariants(&fuzz_before);
+        if (broken == FUZZ_OK && flashed && !fuzz_skip[FUZZ_EFFECTS]) {
+            broken = check_muzzle_flash(flash_x, flash_y);
+        } else {
+            update_particles();
+        }
+        if (broken == FUZZ_OK && game.player_lives <= 0) {
+            // Game over: carry on with a fresh game from the current state
+            game.player_lives = STARTING_LIVES;
+        }
+        if (broken != FUZZ_OK) {
+            *failed_step = step;
+            return broken;
+        }
+    }
+    return FUZZ_OK;
+}
+
+// Check one tick of bitboard collisions against check_collisions() plus
+// a brute-force search for swaps, on random boards where enemies step
+// straight down, diagonally as the AI moves them, or not at all
+static int replay_collisions(unsigned int seed, int boards, int* failed_step) {
+    static GameState moved;
+    int from_x[MAX_ENEMIES], from_y[MAX_ENEMIES];
+    int saved_large_map = large_map_mode, saved_bitboard = bitboard_mode;
+    large_map_mode = 0;
+    bitboard_mode = 1;
+    int broken = FUZZ_OK;
+
+    for (int board = 0; board < boards && broken == FUZZ_OK; board++) {
+        initialize_game_with_seed(seed + (unsigned int)board * 7919u);
+        int w = game.world_width, h = game.world_height;
+
+        // Bullets rise to rows 3 and below, clear of the spawn rows, and
+        // never share a cell, as in a real game
+        for (int e = 0; e < game.enemy_limit; e++) {
+            from_x[e] = game.enemies[e].x = 1 + game_rand() % (w - 2);
+            from_y[e] = game.enemies[e].y = 2 + game_rand() % (h - 6);
+        }
+        for (int b = 0; b < MAX_BULLETS; b++) {
+            Bullet* bullet = &game.bullets[b];
+            bullet->x = 1 + game_rand() % (w - 2);
+            bullet->y = 4 + game_rand() % (h - 6);
+            bullet->active = game_rand() % 4 != 0;
+            for (int other = 0; other < b; other++) {
+                if (game.bullets[other].active && game.bullets[other].x == bullet->x &&
+                    game.bullets[other].y == bullet->y) {
+                    bullet->active = 0;
+                }
+            }
+        }
+
+        // Play the moves of one tick
+        bitboard_rebuild();
+        bitboard_begin_tick();
+        for (int b = 0; b < MAX_BULLETS; b++) {
+            if (game.bullets[b].active) game.bullets[b].y--;
+        }
+        for (int e = 0; e < game.enemy_limit; e++) {
+            int roll = game_rand() % 8;
+            if (!game.enemies[e].active || roll < 2) continue;
+            int to_x = from_x[e] + (roll == 5 ? -1 : roll >= 6 ? 1 : 0);
+            if (to_x < 1) to_x = 1;
+            if (to_x > w - 2) to_x = w - 2;
+            game.enemies[e].x = to_x;
+            game.enemies[e].y = from_y[e] + 1;
+            bitboard_move(from_x[e], from_y[e], to_x, from_y[e] + 1);
+        }
+        memcpy(&moved, &game, sizeof(GameState));
+
+        bitboard_check_collisions();
+        int bitboard_score = game.score, bitboard_bullets = 0;
+        for (int b = 0; b < MAX_BULLETS; b++) {
+            bitboard_bullets += game.bullets[b].active;
+        }
+
+        // The array engine, then every swap it does not look for
+        memcpy(&game, &moved, sizeof(GameState));
+        bitboard_enabled = 0;
+        check_collisions();
+        int array_bullets = 0;
+        for (int b = 0; b < MAX_BULLETS; b++) {
+            Bullet* bullet = &game.bullets[b];
+            for (int e = 0; e < game.enemy_limit && bullet->active; e++) {
+                Enemy* enemy = &game.enemies[e];
+                if (enemy->active && enemy->x == bullet->x && enemy->y == bullet->y + 1 &&
+                    from_x[e] == bullet->x && from_y[e] == bullet->y) {
+                    enemy->active = 0;
+                    unschedule_enemy(e);
+                    bullet->active = 0;
+                    game.score++;
+                }
+            }
+            array_bullets += bullet->active;
+        }
+
+        if (game.score != bitboard_score || array_bullets != bitboard_bullets) {
+            snprintf(fuzz_detail, sizeof(fuzz_detail),
+                     "board %d: bitboard %d kills, %d bullets left; arrays and swaps %d kills, %d left",
+                     board, bitboard_score, bitboard_bullets, game.score, array_bullets);
+            *failed_step = board;
+            broken = FUZZ_ENGINES;
+        }
+    }
+
+    large_map_mode = saved_large_map;
+    bitboard_mode = saved_bitboard;
+    bitboard_enabled = 0;
+    return broken;
+}
+
+// Replay one leaderboard log; each entry packs a name index and a score
+static int replay_leaderboard(const unsigned short* adds, int length, int* failed_step) {
+    free_score_list();
+
+    for (int step = 0; step < length; step++) {
+        char name[MAX_PLAYER_NAME];
+        snprintf(name, sizeof(name), "p%d", adds[step] >> 12);
+        add_high_score(name, adds[step] & 0xfff);
+
+        int broken = check_leaderboard_invariants();
+        if (broken != FUZZ_OK) {
+            *failed_step = step;
+            return broken;
+        }
+    }
+    return FUZZ_OK;
+}
+
+// Shrink a failing log: drop ever smaller chunks, then blank single
+// inputs, keeping each change that still breaks the same invariant
+static int shrink_log(void* log, int item_size, int length, int broken, unsigned int seed, int blank_inputs) {
+    char* items = (char*)log;
+    char* candidate = (char*)malloc((size_t)length * item_size);
+    int failed_step;
+
+    for (int chunk = length / 2; chunk >= 1; chunk /= 2) {
+        int start = 0;
+        while (start < length) {
+            int end = start + chunk < length ? start + chunk : length;
+            int candidate_length = length - (end - start);
+            memcpy(candidate, items, (size_t)start * item_size);
+            memcpy(candidate + (size_t)start * item_size, items + (size_t)end * item_size,
+                   (size_t)(length - end) * item_size);
+
+            int result = item_size == 1
+                ? replay_game(seed, (unsigned char*)candidate, candidate_length, &failed_step)
+                : replay_leaderboard((unsigned short*)candidate, candidate_length, &failed_step);
+
+            if (result == broken) {
+                length = failed_step + 1;
+                memcpy(items, candidate, (size_t)length * item_size);
+            } else {
+                start += chunk;
+            }
+        }
+    }
+
+    for (int i = 0; blank_inputs && i < length; i++) {
+        if (items[i] == FUZZ_IDLE) continue;
+        char saved = items[i];
+        items[i] = FUZZ_IDLE;
+        if (replay_game(seed, (unsigned char*)items, length, &failed_step) == broken) {
+            length = failed_step + 1;
+        } else {
+            items[i] = saved;
+        }
+    }
+
+    free(candidate);
+    return length;
+}
+
+// fuzz subcommand: drive the game and leaderboard with seeded random
+// inputs, check invariants on every step, and shrink any failure
+int run_fuzz(int argc, char* argv[]) {
+    int fuzz_game = 1, fuzz_leaderboard = 1, fuzz_collisions = 1;
+    unsigned int seed = (unsigned int)time(NULL);
+    long long runs = 1000;
+    int steps = 2000;
+    const char* replay = NULL;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "game") == 0) {
+            fuzz_leaderboard = fuzz_collisions = 0;
+        } else if (strcmp(argv[i], "leaderboard") == 0) {
+            fuzz_game = fuzz_collisions = 0;
+        } else if (strcmp(argv[i], "collisions") == 0) {
+            fuzz_game = fuzz_leaderboard = 0;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay = argv[++i];
+            fuzz_leaderboard = 0;
+        } else if (strcmp(argv[i], "--large-map") == 0) {
+            large_map_mode = 1;
+        } else if (strcmp(argv[i], "--ai") == 0) {
+            ai_mode = 1;
+        } else if (strcmp(argv[i], "--bitboard") == 0) {
+            bitboard_mode = 1;
+        } else if (strcmp(argv[i], "--skip") == 0 && i + 1 < argc) {
+            const char* check = argv[++i];
+            for (int c = 1; c < FUZZ_CHECKS; c++) {
+                if (strcmp(check, fuzz_check_names[c]) == 0) fuzz_skip[c] = 1;
+            }
+        } else {
+            printf("Usage: tank_game fuzz [game|leaderboard|collisions] [--seed N] [--runs N] [--steps N]\n");
+            printf("                      [--large-map] [--ai] [--bitboard] [--skip CHECK] [--replay LOG]\n");
+            printf("Checks: bounds overlap tunnel counts wheel effects engines leaderboard\n");
+            return 1;
+        }
+    }
+    if (steps < 1) steps = 1;
+    if (steps > FUZZ_MAX_STEPS) steps = FUZZ_MAX_STEPS;
+
+    // Headless: no messages, no pauses. Effects stay on for their check.
+    quiet_mode = 1;
+
+    static unsigned char actions[FUZZ_MAX_STEPS];
+    static unsigned short adds[FUZZ_MAX_STEPS];
+    int failed_step;
+
+    if (replay != NULL) {
+        int length = 0;
+        for (; replay[length] != '\0' && length < FUZZ_MAX_STEPS; length++) {
+            const char* letter = strchr(fuzz_action_letters, replay[length]);
+            actions[length] = letter ? (unsigned char)(letter - fuzz_action_letters) : FUZZ_IDLE;
+        }
+        int broken = replay_game(seed, actions, length, &failed_step);
+        if (broken == FUZZ_OK) {
+            printf("Replay passed all checks.\n");
+            return 0;
+        }
+        printf("Replay broke '%s' at step %d: %s\n", fuzz_check_names[broken], failed_step, fuzz_detail);
+        return 1;
+    }
+
+    long long total_steps = 0;
+    long long started = now_us();
+
+    for (long long run = 0; run < runs; run++) {
+        unsigned int run_seed = seed + (unsigned int)run * 2654435761u;
+        if (run_seed == 0) run_seed = 1;
+        unsigned int input = run_seed;
+
+        if (fuzz_game) {
+            // Inputs biased toward idling, as in a real game. Only the
+            // large map lets the tank move up and down.
+            for (int i = 0; i < steps; i++) {
+                input ^= input << 13;
+                input ^= input >> 17;
+                input ^= input << 5;
+                int roll = input % (large_map_mode ? 16 : 14);
+                actions[i] = roll < 6 ? FUZZ_IDLE : roll < 9 ? FUZZ_LEFT : roll < 12 ? FUZZ_RIGHT :
+                             roll < 14 ? FUZZ_FIRE : roll < 15 ? FUZZ_UP : FUZZ_DOWN;
+            }
+
+            int broken = replay_game(run_seed, actions, steps, &failed_step);
+            total_steps += broken == FUZZ_OK ? steps : failed_step + 1;
+
+            if (broken != FUZZ_OK) {
+                int length = shrink_log(actions, 1, failed_step + 1, broken, run_seed, 1);
+                replay_game(run_seed, actions, length, &failed_step);
+
+                printf("Game check '%s' failed: %s\n", fuzz_check_names[broken], fuzz_detail);
+                printf("Minimal input log (%d steps):\n  tank_game fuzz --seed %u%s%s%s --replay ",
+                       length, run_seed, large_map_mode ? " --large-map" : "", ai_mode ? " --ai" : "",
+                       bitboard_mode ? " --bitboard" : "");
+                for (int i = 0; i < length; i++) {
+                    putchar(fuzz_action_letters[actions[i]]);
+                }
+                printf("\n");
+                return 1;
+            }
+        }
+
+        if (fuzz_leaderboard) {
+            int length = steps < 200 ? steps : 200;
+            for (int i = 0; i < length; i++) {
+                input ^= input << 13;
+                input ^= input >> 17;
+                input ^= input << 5;
+                adds[i] = (unsigned short)(((input >> 8) % FUZZ_NAMES) << 12 | (input & 0xfff));
+            }
+
+            int broken = replay_leaderboard(adds, length, &failed_step);
+            total_steps += broken == FUZZ_OK ? length : failed_step + 1;
+
+            if (broken != FUZZ_OK) {
+                length = shrink_log(adds, sizeof(unsigned short), failed_step + 1, broken, run_seed, 0);
+                replay_leaderboard(adds, length, &failed_step);
+
+                printf("Leaderboard check failed: %s\n", fuzz_detail);
+                printf("Minimal add_high_score() sequence (%d calls):\n", length);
+                for (int i = 0; i < length; i++) {
+                    printf("  add_high_score(\"p%d\", %d);\n", adds[i] >> 12, adds[i] & 0xfff);
+                }
+                free_score_list();
+                return 1;
+            }
+        }
+
+        if (fuzz_collisions && !fuzz_skip[FUZZ_ENGINES]) {
+            int boards = steps < 200 ? steps : 200;
+            int broken = replay_collisions(run_seed, boards, &failed_step);
+            total_steps += broken == FUZZ_OK ? boards : failed_step + 1;
+
+            if (broken != FUZZ_OK) {
+                printf("Collision check failed: %s\n", fuzz_detail);
+                printf("Reproduce with:\n  tank_game fuzz collisions --seed %u --runs 1\n", run_seed);
+                return 1;
+            }
+        }
+    }
+
+    double seconds = (now_us() - started) / 1e6;
+    printf("%lld runs, %lld steps, no invariant broken (%.0f steps/s)\n",
+           runs, total_steps, seconds > 0 ? total_steps / seconds : 0.0);
+    free_score_list();
+    return 0;
+}
+
+// Write one value into a column of a stats block
+static int write_stats_value(int fd, off_t block_start, size_t column, int row, const void* value, size_t size) {
+    off_t offset = block_start + column + (off_t)row * size;
+    return pwrite(fd, value, size, offset) == (ssize_t)size;
+}
+
+// Take what the stats log and leaderboard keep from the current game
+void describe_finished_game(FinishedGame* finished) {
+    memset(finished, 0, sizeof(FinishedGame));
+    snprintf(finished->name, sizeof(finished->name), "%s", player_name);
+    finished->score = game.score;
+    finished->ticks = game.ticks;
+    finished->shots_fired = game.shots_fired;
+    finished->hits = game.hits;
+    finished->player_lives = game.player_lives;
+}
+
+// Append a finished game to the statistics log
+void record_game_stats(const FinishedGame* finished) {
+    int fd = open(STATS_FILE, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        return;
+    }
+
+    // Several games may finish at once on a kiosk
+    flock(fd, LOCK_EX);
+
+    struct stat info;
+    long long block_count = fstat(fd, &info) == 0 ? info.st_size / (long long)sizeof(StatsBlock) : 0;
+    long long block = block_count - 1;
+
+    StatsBlockHeader header;
+    if (block < 0 ||
+        pread(fd, &header, sizeof(header), block * (off_t)sizeof(StatsBlock)) != sizeof(header) ||
+        header.magic != STATS_MAGIC || header.rows >= STATS_BLOCK_ROWS) {
+        // Start a new block at the end of the file
+        block = block_count;
+        if (ftruncate(fd, (block + 1) * (off_t)sizeof(StatsBlock)) != 0) {
+            flock(fd, LOCK_UN);
+            close(fd);
+            return;
+        }
+        memset(&header, 0, sizeof(header));
+        header.magic = STATS_MAGIC;
+    }
+
+    off_t start = block * (off_t)sizeof(StatsBlock);
+    int row = header.rows;
+
+    long long now = (long long)time(NULL);
+    int score = finished->score;
+    int length_ms = finished->ticks * TICK_MS;
+    int lives_lost = STARTING_LIVES - (finished->player_lives > 0 ? finished->player_lives : 0);
+
+    // Columns first, header last, so a crash never exposes a half-written row
+    int ok = write_stats_value(fd, start, offsetof(StatsBlock, names), row, finished->name, MAX_PLAYER_NAME) &&
+             write_stats_value(fd, start, offsetof(StatsBlock, times), row, &now, sizeof(now)) &&
+             write_stats_value(fd, start, offsetof(StatsBlock, scores), row, &score, sizeof(int)) &&
+             write_stats_value(fd, start, offsetof(StatsBlock, lengths_ms), row, &length_ms, sizeof(int)) &&
+             write_stats_value(fd, start, offsetof(StatsBlock, shots_fired), row, &finished->shots_fired, sizeof(int)) &&
+             write_stats_value(fd, start, offsetof(StatsBlock, hits), row, &finished->hits, sizeof(int)) &&
+             write_stats_value(fd, start, offsetof(StatsBlock, lives_lost), row, &lives_lost, sizeof(int));
+
+    if (ok) {
+        if (row == 0 || now < header.min_time) header.min_time = now;
+        if (row == 0 || now > header.max_time) header.max_time = now;
+        if (row == 0 || score < header.min_score) header.min_score = score;
+        if (row == 0 || score > header.max_score) header.max_score = score;
+        if (row == 0 || length_ms < header.min_length_ms) header.min_length_ms = length_ms;
+        if (row == 0 || length_ms > header.max_length_ms) header.max_length_ms = length_ms;
+        header.rows = row + 1;
+        pwrite(fd, &header, sizeof(header), start);
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+// Compare function for sorting scores
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values
+static int percentile(const int* sorted, int count, int percent) {
+    int rank = (percent * count + 99) / 100;
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+// Hash of a fixed-width name column entry (FNV-1a)
+static unsigned int hash_name(const char* name) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < MAX_PLAYER_NAME && name[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// stats subcommand: aggregate the log, reading only the columns needed
+int run_stats(int argc, char* argv[]) {
+    const char* only_player = NULL;
+    int days = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--player") == 0 && i + 1 < argc) {
+            only_player = argv[++i];
+        } else if (strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+            days = atoi(argv[++i]);
+        } else {
+            printf("Usage: tank_game stats [--player NAME] [--days N]\n");
+            return 1;
+        }
+    }
+
+    int fd = open(STATS_FILE, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(StatsBlock)) {
+        printf("No games recorded yet.\n");
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+
+    long long block_count = info.st_size / (long long)sizeof(StatsBlock);
+    void* memory = mmap(NULL, block_count * sizeof(StatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        printf("Could not read %s\n", STATS_FILE);
+        return 1;
+    }
+    const StatsBlock* blocks = (const StatsBlock*)memory;
+
+    long long since = days > 0 ? (long long)time(NULL) - (long long)days * 86400 : LLONG_MIN;
+
+    // Work out the day range from block headers alone
+    long long first_day = LLONG_MAX, last_day = LLONG_MIN;
+    for (long long b = 0; b < block_count; b++) {
+        const StatsBlockHeader* header = &blocks[b].header;
+        if (header->magic != STATS_MAGIC || header->rows <= 0 || header->max_time < since) continue;
+        if (header->min_time / 86400 < first_day) first_day = header->min_time / 86400;
+        if (header->max_time / 86400 > last_day) last_day = header->max_time / 86400;
+    }
+    if (first_day > last_day) {
+        printf("No games recorded in that period.\n");
+        munmap(memory, block_count * sizeof(StatsBlock));
+        return 0;
+    }
+    if (since != LLONG_MIN && since / 86400 > first_day) {
+        first_day = since / 86400;
+    }
+
+    int day_count = (int)(last_day - first_day + 1);
+    long long* games_per_day = (long long*)calloc(day_count, sizeof(long long));
+
+    // Open-addressing table from name to player totals
+    int table_size = 1024;
+    int player_count = 0;
+    PlayerStats* players = (PlayerStats*)calloc(table_size, sizeof(PlayerStats));
+    long long total_games = 0;
+    int out_of_memory = games_per_day == NULL || players == NULL;
+
+    for (long long b = 0; b < block_count && !out_of_memory; b++) {
+        const StatsBlock* block = &blocks[b];
+        const StatsBlockHeader* header = &block->header;
+        if (header->magic != STATS_MAGIC || header->max_time < since) continue;
+        int rows = header->rows < STATS_BLOCK_ROWS ? header->rows : STATS_BLOCK_ROWS;
+
+        for (int r = 0; r < rows && !out_of_memory; r++) {
+            if (block->times[r] < since) continue;
+            if (only_player && strncmp(block->names[r], only_player, MAX_PLAYER_NAME) != 0) continue;
+
+            games_per_day[block->times[r] / 86400 - first_day]++;
+            total_games++;
+
+            // Grow the table before it gets crowded
+            if ((player_count + 1) * 2 > table_size) {
+                int new_size = table_size * 2;
+                PlayerStats* grown = (PlayerStats*)calloc(new_size, sizeof(PlayerStats));
+                if (grown == NULL) {
+                    out_of_memory = 1;
+                    break;
+                }
+                for (int i = 0; i < table_size; i++) {
+                    if (players[i].games == 0) continue;
+                    unsigned int slot = hash_name(players[i].name) & (new_size - 1);
+                    while (grown[slot].games != 0) slot = (slot + 1) & (new_size - 1);
+                    grown[slot] = players[i];
+                }
+                free(players);
+                players = grown;
+                table_size = new_size;
+            }
+
+            unsigned int slot = hash_name(block->names[r]) & (table_size - 1);
+            while (players[slot].games != 0 &&
+                   strncmp(players[slot].name, block->names[r], MAX_PLAYER_NAME) != 0) {
+                slot = (slot + 1) & (table_size - 1);
+            }
+
+            PlayerStats* player = &players[slot];
+            if (player->games == 0) {
+                memcpy(player->name, block->names[r], MAX_PLAYER_NAME);
+                player->name[MAX_PLAYER_NAME - 1] = '\0';
+                player_count++;
+            }
+            if (player->games == player->scores_capacity) {
+                int capacity = player->scores_capacity ? player->scores_capacity * 2 : 16;
+                int* scores = (int*)realloc(player->scores, capacity * sizeof(int));
+                if (scores == NULL) {
+                    out_of_memory = 1;
+                    break;
+                }
+                player->scores = scores;
+                player->scores_capacity = capacity;
+            }
+
+            player->scores[player->games++] = block->scores[r];
+            player->total_score += block->scores[r];
+            player->shots_fired += block->shots_fired[r];
+            player->hits += block->hits[r];
+            player->lives_lost += block->lives_lost[r];
+            player->length_ms += block->lengths_ms[r];
+        }
+    }
+
+    if (out_of_memory) {
+        printf("Not enough memory to summarize %s\n", STATS_FILE);
+        for (int i = 0; players != NULL && i < table_size; i++) {
+            free(players[i].scores);
+        }
+        free(players);
+        free(games_per_day);
+        munmap(memory, block_count * sizeof(StatsBlock));
+        return 1;
+    }
+
+    printf("\n    %sGAME STATISTICS (%lld games)%s\n\n", YELLOW, total_games, RESET);
+    printf("    %s%-20s %7s %8s %6s %6s %8s %10s%s\n", CYAN,
+           "Player", "Games", "Mean", "P50", "P90", "Hit %", "Lives/min", RESET);
+
+    for (int i = 0; i < table_size; i++) {
+        PlayerStats* player = &players[i];
+        if (player->games == 0) continue;
+
+        qsort(player->scores, player->games, sizeof(int), compare_ints);
+        double minutes = player->length_ms / 60000.0;
+
+        printf("    %-20s %7d %8.1f %6d %6d %7.1f%% %10.2f\n",
+               player->name, player->games,
+               (double)player->total_score / player->games,
+               percentile(player->scores, player->games, 50),
+               percentile(player->scores, player->games, 90),
+               player->shots_fired ? 100.0 * player->hits / player->shots_fired : 0.0,
+               minutes > 0 ? player->lives_lost / minutes : 0.0);
+        free(player->scores);
+    }
+
+    printf("\n    %sGames per day%s\n\n", CYAN, RESET);
+    for (int d = 0; d < day_count; d++) {
+        if (games_per_day[d] == 0) continue;
+        time_t day_start = (time_t)((first_day + d) * 86400);
+        struct tm* date = gmtime(&day_start);
+        printf("    %04d-%02d-%02d %10lld\n", date->tm_year + 1900, date->tm_mon + 1, date->tm_mday,
+               games_per_day[d]);
+    }
+    printf("\n");
+
+    free(players);
+    free(games_per_day);
+    munmap(memory, block_count * sizeof(StatsBlock));
+    return 0;
+}
+
+// Append formatted text to the current frame
+void frame_printf(const char* format, ...) {
+    int space = FRAME_BUFFER_SIZE - frame_length;
+    if (space <= 1) return;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(frame_buffer + frame_length, space, format, args);
+    va_end(args);
+
+    if (written > 0) {
+        frame_length += min(written, space - 1);
+    }
+}
+
+// Remember how long it took to get something on screen
+static void note_first_frame() {
+    if (process_start_us != 0 && atomic_load_explicit(&time_to_first_frame_us, memory_order_relaxed) == 0) {
+        atomic_store_explicit(&time_to_first_frame_us, now_us() - process_start_us, memory_order_relaxed);
+    }
+}
+
+// Write the finished frame to the terminal and hand it to spectators
+void present_frame() {
+    if (current_session != NULL) {
+        // A client that has not taken the last frame yet skips this one
+        session_send(current_session, frame_buffer, frame_length, 1);
+        return;
+    }
+
+    fwrite(frame_buffer, 1, frame_length, stdout);
+    fflush(stdout);
+    note_first_frame();
+
+    if (spectate_ring != NULL) {
+        publish_frame(frame_buffer, frame_length);
+    }
+
+    if (recording) {
+        record_frame(frame_buffer, frame_length);
+    }
+}
+
+// Write a menu or message screen. Unlike game frames these are never
+// skipped, and spectators and recordings only get the game itself.
+void present_screen() {
+    if (current_session != NULL) {
+        session_send(current_session, frame_buffer, frame_length, 0);
+        return;
+    }
+
+    fwrite(frame_buffer, 1, frame_length, stdout);
+    fflush(stdout);
+    note_first_frame();
+}
+
+// Copy bytes into the record queue at a position, wrapping at the end
+static void record_queue_write(unsigned long position, const void* data, int length) {
+    unsigned long offset = position % RECORD_QUEUE_BYTES;
+    unsigned long first = RECORD_QUEUE_BYTES - offset;
+    if (first > (unsigned long)length) first = length;
+
+    memcpy(record_queue + offset, data, first);
+    memcpy(record_queue, (const char*)data + first, length - first);
+}
+
+// Copy bytes out of the record queue, wrapping at the end
+static void record_queue_read(unsigned long position, void* data, int length) {
+    unsigned long offset = position % RECORD_QUEUE_BYTES;
+    unsigned long first = RECORD_QUEUE_BYTES - offset;
+    if (first > (unsigned long)length) first = length;
+
+    memcpy(data, record_queue + offset, first);
+    memcpy((char*)data + first, record_queue, length - first);
+}
+
+// Open the cast file (piped through gzip for .gz names) and start the
+// recorder thread
+int start_recording(const char* path) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+
+    size_t path_length = strlen(path);
+    if (path_length > 3 && strcmp(path + path_length - 3, ".gz") == 0) {
+        // Stream through gzip so compression happens off the game thread
+        int pipe_fds[2];
+        if (pipe(pipe_fds) != 0) {
+            close(fd);
+            return 0;
+        }
+
+        record_compressor = fork();
+        if (record_compressor == 0) {
+            dup2(pipe_fds[0], STDIN_FILENO);
+            dup2(fd, STDOUT_FILENO);
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+            close(fd);
+            execlp("gzip", "gzip", "-c", (char*)NULL);
+            _exit(127);
+        }
+
+        close(pipe_fds[0]);
+        close(fd);
+        if (record_compressor < 0) {
+            close(pipe_fds[1]);
+            return 0;
+        }
+        record_file = fdopen(pipe_fds[1], "w");
+    } else {
+        record_file = fdopen(fd, "w");
+    }
+
+    if (record_file == NULL) {
+        return 0;
+    }
+
+    // The header is sized to the terminal we are recording
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+        record_columns = size.ws_col;
+        record_rows = size.ws_row;
+    }
+
+    record_start_us = now_us();
+    atomic_store(&record_stop, 0);
+    atomic_store(&record_failed, 0);
+    if (pthread_create(&record_thread, NULL, recorder_main, NULL) != 0) {
+        // Nothing has been written, so closing can't raise SIGPIPE here
+        fclose(record_file);
+        record_file = NULL;
+        if (record_compressor > 0) {
+            waitpid(record_compressor, NULL, 0);
+            record_compressor = -1;
+        }
+        return 0;
+    }
+
+    recording = 1;
+    return 1;
+}
+
+// Let the recorder drain whatever is queued and close the file
+void stop_recording() {
+    if (!recording) return;
+
+    recording = 0;
+    atomic_store(&record_stop, 1);
+    pthread_join(record_thread, NULL);
+    if (atomic_load(&record_failed)) {
+        printf("The recording stopped early: its output could not be written.\n");
+    }
+
+    if (record_compressor > 0) {
+        waitpid(record_compressor, NULL, 0);
+        record_compressor = -1;
+    }
+}
+
+// Queue a finished frame. Only memory copies happen here: no locks,
+// no syscalls, and a full queue drops the frame instead of waiting.
+void record_frame(const char* data, int length) {
+    if (atomic_load_explicit(&record_failed, memory_order_relaxed)) return;
+
+    RecordHeader header;
+    header.time_us = now_us() - record_start_us;
+    header.length = length;
+    header.padding = 0;
+
+    // Keep every record 8-byte aligned in the ring
+    unsigned long needed = (sizeof(RecordHeader) + length + 7) & ~7ul;
+    unsigned long head = atomic_load_explicit(&record_head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&record_tail, memory_order_acquire);
+    if (RECORD_QUEUE_BYTES - (head - tail) < needed) {
+        atomic_fetch_add_explicit(&record_dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    record_queue_write(head, &header, sizeof(header));
+    record_queue_write(head + sizeof(header), data, length);
+    atomic_store_explicit(&record_head, head + needed, memory_order_release);
+}
+
+// Recorder thread: turn queued frames into asciicast output events. It
+// owns the file and closes it. SIGPIPE is blocked here so a gzip that
+// died shows up as EPIPE, which ends the recording instead of the game.
+void* recorder_main(void* unused) {
+    (void)unused;
+    static char frame[FRAME_BUFFER_SIZE];
+
+    sigset_t pipe_signal;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+    // asciicast v2 header
+    fprintf(record_file, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %lld, "
+            "\"env\": {\"TERM\": \"xterm-256color\"}, \"title\": \"Tank BattleShip\"}\n",
+            record_columns, record_rows, (long long)time(NULL));
+
+    while (!ferror(record_file)) {
+        unsigned long tail = atomic_load_explicit(&record_tail, memory_order_relaxed);
+        unsigned long head = atomic_load_explicit(&record_head, memory_order_acquire);
+
+        if (tail == head) {
+            if (atomic_load(&record_stop)) {
+                break;
+            }
+            usleep(5000);
+            continue;
+        }
+
+        RecordHeader header;
+        record_queue_read(tail, &header, sizeof(header));
+        int length = header.length;
+        record_queue_read(tail + sizeof(header), frame, length);
+        atomic_store_explicit(&record_tail, tail + ((sizeof(RecordHeader) + length + 7) & ~7ul),
+                              memory_order_release);
+
+        // [time, "o", "data"] with the data as a JSON string
+        fprintf(record_file, "[%lld.%06lld, \"o\", \"", header.time_us / 1000000, header.time_us % 1000000);
+        for (int i = 0; i < length; i++) {
+            unsigned char c = (unsigned char)frame[i];
+            if (c == '"' || c == '\\') {
+                fputc('\\', record_file);
+                fputc(c, record_file);
+            } else if (c == '\n') {
+                fputs("\\r\\n", record_file);  // what the terminal actually receives
+            } else if (c == '\r') {
+                fputs("\\r", record_file);
+            } else if (c < 0x20 || c == 0x7f) {
+                fprintf(record_file, "\\u%04x", c);
+            } else {
+                fputc(c, record_file);
+            }
+        }
+        fputs("\"]\n", record_file);
+    }
+
+    // A pending SIGPIPE is discarded with this thread
+    if (fclose(record_file) != 0) {
+        atomic_store(&record_failed, 1);
+    }
+    record_file = NULL;
+    return NULL;
+}
+
+// Create the shared memory ring that spectators attach to. Only one game
+// may write it: the flock stays held until close_broadcast() or exit, so a
+// second --broadcast fails with EWOULDBLOCK instead of resetting the ring
+// under the first one's spectators.
+int open_broadcast() {
+    int fd = shm_open(SPECTATE_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || ftruncate(fd, sizeof(SpectateRing)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return 0;
+    }
+
+    void* memory = mmap(NULL, sizeof(SpectateRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+    spectate_fd = fd;
+
+    spectate_ring = (SpectateRing*)memory;
+    spectate_ring->slot_count = SPECTATE_SLOTS;
+    atomic_store(&spectate_ring->frames_published, 0);
+    for (int i = 0; i < SPECTATE_SLOTS; i++) {
+        atomic_store(&spectate_ring->slots[i].sequence, 0);
+    }
+    atomic_store(&spectate_ring->live, 1);
+    spectate_ring->magic = SPECTATE_MAGIC;
+    return 1;
+}
+
+// Tell spectators the game has ended and remove the ring
+void close_broadcast() {
+    if (spectate_ring == NULL) return;
+
+    atomic_store(&spectate_ring->live, 0);
+    munmap(spectate_ring, sizeof(SpectateRing));
+    spectate_ring = NULL;
+    shm_unlink(SPECTATE_SHM_NAME);
+
+    // Releases the lock for the next broadcaster
+    close(spectate_fd);
+    spectate_fd = -1;
+}
+
+// Copy a frame into the next slot. The game never waits for readers:
+// a slot is overwritten whether or not anyone has looked at it yet.
+void publish_frame(const char* data, int length) {
+    unsigned long frame = atomic_load_explicit(&spectate_ring->frames_published, memory_order_relaxed);
+    SpectateSlot* slot = &spectate_ring->slots[frame % SPECTATE_SLOTS];
+    unsigned long sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+
+    // Odd sequence marks the slot as being written
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(slot->data, data, length);
+    slot->length = length;
+
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&spectate_ring->frames_published, frame + 1, memory_order_release);
+}
+
+// Spectator client: map the ring read-only and draw the newest frame
+int run_spectator() {
+    int fd = shm_open(SPECTATE_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        printf("No game is broadcasting. Start one with --broadcast.\n");
+        return 1;
+    }
+
+    // The fd stays open: the broadcaster's flock on it is how we tell
+    // that it is still running
+    void* memory = mmap(NULL, sizeof(SpectateRing), PROT_READ, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        printf("Could not attach to the broadcast.\n");
+        return 1;
+    }
+
+    SpectateRing* ring = (SpectateRing*)memory;
+    if (ring->magic != SPECTATE_MAGIC) {
+        printf("Broadcast is not ready yet.\n");
+        munmap(memory, sizeof(SpectateRing));
+        close(fd);
+        return 1;
+    }
+
+    static char frame[FRAME_BUFFER_SIZE];
+    unsigned long last_shown = 0;
+    int idle_polls = 0;
+
+    while (atomic_load(&ring->live)) {
+        unsigned long published = atomic_load_explicit(&ring->frames_published, memory_order_acquire);
+        if (published == last_shown) {
+            // A broadcaster that died never clears live, but its lock
+            // went with it
+            if (++idle_polls >= SPECTATE_CHECK_POLLS) {
+                idle_polls = 0;
+                if (flock(fd, LOCK_SH | LOCK_NB) == 0) {
+                    printf("\n    %sThe broadcasting game stopped without ending the broadcast.%s\n\n",
+                           RED, RESET);
+                    munmap(memory, sizeof(SpectateRing));
+                    close(fd);
+                    return 1;
+                }
+            }
+            usleep(10000);
+            continue;
+        }
+        idle_polls = 0;
+
+        // Always jump to the newest frame, skipping any we fell behind on
+        const SpectateSlot* slot = &ring->slots[(published - 1) % SPECTATE_SLOTS];
+        unsigned long before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        int length = slot->length;
+        if (length < 0 || length > FRAME_BUFFER_SIZE) {
+            continue;
+        }
+        memcpy(frame, slot->data, length);
+
+        atomic_thread_fence(memory_order_acquire);
+        unsigned long after = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+        if (before != after) {
+            // Writer lapped us mid-copy, try again with the newer frame
+            continue;
+        }
+
+        fwrite(frame, 1, length, stdout);
+        fflush(stdout);
+        last_shown = published;
+    }
+
+    printf("\n    %sBroadcast ended.%s\n\n", YELLOW, RESET);
+    munmap(memory, sizeof(SpectateRing));
+    close(fd);
+    return 0;
+}
+
+// Queue bytes for a session's socket. Whatever the socket takes right
+// away is written directly; the rest waits for EPOLLOUT. A droppable game
+// frame is skipped while older bytes are still waiting, and a client that
+// falls SESSION_OUTPUT_LIMIT behind is disconnected, so a slow reader
+// never holds up the worker's other sessions.
+void session_send(Session* session, const char* data, int length, int droppable) {
+    if (session->state == SESSION_CLOSED) return;
+
+    if (session->output_length > 0) {
+        if (droppable) {
+            atomic_fetch_add_explicit(&server_frames_dropped, 1, memory_order_relaxed);
+            return;
+        }
+    } else {
+        while (length > 0) {
+            ssize_t written = send(session->fd, data, length, MSG_NOSIGNAL);
+            if (written > 0) {
+                data += written;
+                length -= (int)written;
+            } else if (written < 0 && errno == EINTR) {
+                continue;
+            } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                session->state = SESSION_CLOSED;
+                return;
+            }
+        }
+        if (length == 0) return;
+    }
+
+    if (session->output_length + length > SESSION_OUTPUT_LIMIT) {
+        session->state = SESSION_CLOSED;
+        session->output_length = 0;
+        return;
+    }
+
+    if (session->output_length + length > session->output_capacity) {
+        int capacity = session->output_capacity ? session->output_capacity : 4096;
+        while (capacity < session->output_length + length) {
+            capacity *= 2;
+        }
+        char* output = (char*)realloc(session->output, capacity);
+        if (output == NULL) {
+            session->state = SESSION_CLOSED;
+            return;
+        }
+        atomic_fetch_add_explicit(&server_output_bytes, capacity - session->output_capacity, memory_order_relaxed);
+        session->output = output;
+        session->output_capacity = capacity;
+    }
+
+    memcpy(session->output + session->output_length, data, length);
+    session->output_length += length;
+}
+
+// Write out as much queued output as the socket will take
+static void session_flush(Session* session) {
+    int sent = 0;
+    while (sent < session->output_length) {
+        ssize_t written = send(session->fd, session->output + sent, session->output_length - sent, MSG_NOSIGNAL);
+        if (written > 0) {
+            sent += (int)written;
+        } else if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            session->state = SESSION_CLOSED;
+            session->output_length = 0;
+            return;
+        }
+    }
+
+    memmove(session->output, session->output + sent, session->output_length - sent);
+    session->output_length -= sent;
+}
+
+// Load a session into this thread's game state
+static void session_enter(Session* session) {
+    current_session = session;
+    restore_game_state(&session->game);
+    snprintf(player_name, sizeof(player_name), "%s", session->name);
+    show_frame_stats = session->show_frame_stats;
+}
+
+// Store this thread's game state back into the session
+static void session_leave(Session* session) {
+    memcpy(&session->game, &game, sizeof(GameState));
+    session->show_frame_stats = show_frame_stats;
+    current_session = NULL;
+}
+
+// Move a session to a screen and draw it
+static void session_show(Session* session, int state) {
+    session->state = state;
+    switch (state) {
+        case SESSION_MENU:
+            draw_main_menu();
+            break;
+        case SESSION_NAME:
+            session->name_length = 0;
+            session->name[0] = '\0';
+            draw_name_prompt(session->name);
+            break;
+        case SESSION_CONTROLS:
+            draw_controls();
+            break;
+        case SESSION_PLAYING:
+            // The first frame comes with the first tick
+            initialize_game();
+            session->input_count = 0;
+            atomic_fetch_add_explicit(&metric_games, 1, memory_order_relaxed);
+            return;
+        case SESSION_GAME_OVER:
+            draw_game_over();
+            break;
+        case SESSION_GAME_OVER_MENU:
+            draw_game_over_menu();
+            break;
+        case SESSION_SCORES:
+            draw_high_scores();
+            break;
+        case SESSION_SEARCH:
+            session->query_length = 0;
+            session->query[0] = '\0';
+            draw_player_search(session->query);
+            break;
+        case SESSION_ABOUT:
+            draw_about_developers();
+            break;
+        case SESSION_INVALID:
+            session->wait_ticks = INVALID_INPUT_TICKS;
+            draw_invalid_input();
+            break;
+        default:
+            return;
+    }
+    present_screen();
+}
+
+// Say goodbye and disconnect after the output has gone
+static void session_quit(Session* session) {
+    frame_length = 0;
+    frame_printf("\033[2J\033[H\nThanks for playing!\n\n");
+    present_screen();
+    session->state = SESSION_CLOSED;
+}
+
+// Handle one key outside the game itself, like the terminal menus do
+static void session_key(Session* session, char c) {
+    switch (session->state) {
+        case SESSION_MENU:
+        case SESSION_GAME_OVER_MENU:
+            if (c == '1') {
+                session_show(session, session->state == SESSION_MENU ? SESSION_NAME : SESSION_CONTROLS);
+            } else if (c == '2') {
+                session->return_state = session->state;
+                session_show(session, SESSION_SCORES);
+            } else if (c == '3') {
+                session_show(session, session->state == SESSION_MENU ? SESSION_ABOUT : SESSION_MENU);
+            } else if (c == '4') {
+                session_quit(session);
+            } else {
+                session->return_state = session->state;
+                session_show(session, SESSION_INVALID);
+            }
+            break;
+        case SESSION_CONTROLS:
+            session_show(session, SESSION_PLAYING);
+            break;
+        case SESSION_PLAYING:
+            if (session->input_count < SESSION_INPUT_QUEUE) {
+                session->input[session->input_count++] = (unsigned char)c;
+            }
+            break;
+        case SESSION_GAME_OVER:
+            session_show(session, SESSION_GAME_OVER_MENU);
+            break;
+        case SESSION_SCORES:
+            session_show(session, c == 's' || c == 'S' ? SESSION_SEARCH : session->return_state);
+            break;
+        case SESSION_ABOUT:
+            session_show(session, SESSION_MENU);
+            break;
+    }
+}
+
+// Feed one received byte through the telnet filter and the line editor
+static void session_input(Session* session, unsigned char c) {
+    switch (session->telnet_state) {
+        case TELNET_DATA:
+            if (c == 255) {
+                session->telnet_state = TELNET_COMMAND;
+                return;
+            }
+            break;
+        case TELNET_COMMAND:
+            if (c >= 251 && c <= 254) {
+                session->telnet_state = TELNET_OPTION;  // WILL, WONT, DO, DONT
+            } else if (c == 250) {
+                session->telnet_state = TELNET_SUBNEGOTIATION;
+            } else {
+                session->telnet_state = TELNET_DATA;
+            }
+            return;
+        case TELNET_OPTION:
+            session->telnet_state = TELNET_DATA;
+            return;
+        case TELNET_SUBNEGOTIATION:
+            if (c == 255) session->telnet_state = TELNET_SUBNEGOTIATION_IAC;
+            return;
+        case TELNET_SUBNEGOTIATION_IAC:
+            session->telnet_state = c == 240 ? TELNET_DATA : TELNET_SUBNEGOTIATION;
+            return;
+    }
+
+    // Clients in line mode send CR LF or CR NUL for Enter
+    unsigned char previous = session->last_byte;
+    session->last_byte = c;
+    if ((c == '\n' || c == '\0') && previous == '\r') return;
+
+    if (session->state == SESSION_NAME || session->state == SESSION_SEARCH) {
+        // Line editing as in get_player_name() and search_players()
+        int naming = session->state == SESSION_NAME;
+        char* text = naming ? session->name : session->query;
+        int* length = naming ? &session->name_length : &session->query_length;
+
+        if (c == '\r' || c == '\n') {
+            if (!naming) {
+                session_show(session, session->return_state);
+                return;
+            }
+
+            // If empty name, use "Player"
+            if (session->name_length == 0) {
+                strcpy(session->name, "Player");
+            }
+            snprintf(player_name, sizeof(player_name), "%s", session->name);
+            session_show(session, SESSION_CONTROLS);
+            return;
+        } else if (c == '\t' && naming) {
+            complete_player_name(text, length);
+        } else if ((c == 127 || c == '\b') && *length > 0) {
+            text[--(*length)] = '\0';
+        } else if (isgraph(c) && *length < MAX_PLAYER_NAME - 1) {
+            text[(*length)++] = (char)c;
+            text[*length] = '\0';
+        } else {
+            return;
+        }
+
+        if (naming) {
+            draw_name_prompt(text);
+        } else {
+            draw_player_search(text);
+        }
+        present_screen();
+        return;
+    }
+
+    if (c == '\r' || c == '\n' || c == '\0' || session->state == SESSION_INVALID) return;
+    session_key(session, (char)c);
+}
+
+// Read everything the client has sent (the socket is edge-triggered)
+static void session_read(Session* session) {
+    unsigned char buffer[512];
+    while (session->state != SESSION_CLOSED) {
+        ssize_t received = recv(session->fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            session_enter(session);
+            for (ssize_t i = 0; i < received && session->state != SESSION_CLOSED; i++) {
+                session_input(session, buffer[i]);
+            }
+            session_leave(session);
+        } else if (received < 0 && errno == EINTR) {
+            continue;
+        } else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else {
+            session->state = SESSION_CLOSED;
+        }
+    }
+}
+
+// One game tick for a playing session: at most one key, as in play_game()
+static void session_tick(Session* session) {
+    session_enter(session);
+
+    if (session->input_count > 0) {
+        char c = (char)tolower(session->input[0]);
+        session->input_count--;
+        memmove(session->input, session->input + 1, session->input_count);
+
+        if (c == 'a' || c == 'd' || (large_map_mode && (c == 'w' || c == 'x'))) {
+            move_player(c);
+        } else if (c == 'f') {
+            fire_bullet();
+        } else if (c == 'm') {
+            session_show(session, SESSION_MENU);
+            session_leave(session);
+            return;
+        } else if (c == 't') {
+            show_frame_stats = !show_frame_stats;
+        } else if (c == 'q') {
+            session_quit(session);
+            session_leave(session);
+            return;
+        }
+    }
+
+    long long frame_start = now_us();
+    update_game();
+    frame_stats.update_us = now_us() - frame_start;
+    render_game();
+    frame_stats.total_us = now_us() - frame_start;
+
+    observe(&tick_histogram, frame_stats.update_us);
+    observe(&frame_histogram, frame_stats.total_us);
+
+    if (game.player_lives <= 0) {
+        session_show(session, SESSION_GAME_OVER);
+    }
+
+    session_leave(session);
+}
+
+// Unlink and free a closed session
+static void session_close(ServerWorker* worker, Session* session) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, session->fd, NULL);
+    close(session->fd);
+
+    if (session->prev != NULL) {
+        session->prev->next = session->next;
+    } else {
+        worker->sessions = session->next;
+    }
+    if (session->next != NULL) {
+        session->next->prev = session->prev;
+    }
+
+    atomic_fetch_sub_explicit(&server_output_bytes, session->output_capacity, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&server_sessions, 1, memory_order_relaxed);
+    free(session->output);
+    free(session);
+}
+
+// Take new connections. Every worker waits on the listening socket with
+// EPOLLEXCLUSIVE, so each connection wakes one worker, which then owns it.
+static void server_accept(ServerWorker* worker) {
+    // Character mode: we echo, and the client sends keys as they are typed
+    static const char negotiation[] = { (char)255, (char)251, 1, (char)255, (char)251, 3 };
+
+    for (int accepted = 0; accepted < 32; accepted++) {
+        int fd = accept(server_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;  // EAGAIN, or out of descriptors until someone leaves
+        }
+
+        Session* session = (Session*)calloc(1, sizeof(Session));
+        if (session == NULL) {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        session->fd = fd;
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = session;
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            free(session);
+            continue;
+        }
+
+        session->next = worker->sessions;
+        if (worker->sessions != NULL) {
+            worker->sessions->prev = session;
+        }
+        worker->sessions = session;
+        atomic_fetch_add_explicit(&server_sessions, 1, memory_order_relaxed);
+
+        current_session = session;
+        session_send(session, negotiation, sizeof(negotiation), 0);
+        session_show(session, SESSION_MENU);
+        current_session = NULL;
+    }
+}
+
+// Worker thread: socket events as they come, and a game tick for all of
+// its sessions every TICK_MS
+void* server_worker_main(void* arg) {
+    ServerWorker* worker = (ServerWorker*)arg;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+
+    // Effects would cost every session a particle pool
+    particles_enabled = 0;
+
+    long long next_tick = now_us() + TICK_MS * 1000;
+    while (1) {
+        long long wait_ms = (next_tick - now_us() + 999) / 1000;
+        int count = epoll_wait(worker->epoll_fd, events, SERVER_MAX_EVENTS, wait_ms > 0 ? (int)wait_ms : 0);
+
+        for (int i = 0; i < count; i++) {
+            Session* session = (Session*)events[i].data.ptr;
+            if (session == NULL) {
+                server_accept(worker);
+                continue;
+            }
+
+            if (events[i].events & EPOLLIN) {
+                session_read(session);
+            }
+            if (events[i].events & EPOLLOUT && session->output_length > 0) {
+                session_flush(session);
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                session->state = SESSION_CLOSED;
+                session->output_length = 0;
+            }
+            if (session->state == SESSION_CLOSED && session->output_length == 0) {
+                session_close(worker, session);
+            }
+        }
+
+        long long now = now_us();
+        if (now < next_tick) continue;
+
+        // Skip ticks rather than run several back to back after a stall
+        next_tick += TICK_MS * 1000;
+        if (next_tick < now) {
+            next_tick = now + TICK_MS * 1000;
+        }
+
+        Session* session = worker->sessions;
+        while (session != NULL) {
+            Session* next = session->next;
+            if (session->state == SESSION_PLAYING) {
+                session_tick(session);
+            } else if (session->state == SESSION_INVALID && --session->wait_ticks <= 0) {
+                current_session = session;
+                session_show(session, session->return_state);
+                current_session = NULL;
+            }
+
+            // Goodbyes get one tick to drain before the connection goes
+            if (session->state == SESSION_CLOSED) {
+                session_close(worker, session);
+            }
+            session = next;
+        }
+    }
+    return NULL;
+}
+
+// Hand a finished game to the score writer without waiting
+void queue_finished_game(const FinishedGame* finished) {
+    pthread_mutex_lock(&score_queue_lock);
+    if (score_queue_count == SCORE_QUEUE_SIZE) {
+        pthread_mutex_unlock(&score_queue_lock);
+        atomic_fetch_add_explicit(&score_queue_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    score_queue[(score_queue_head + score_queue_count) % SCORE_QUEUE_SIZE] = *finished;
+    score_queue_count++;
+    pthread_cond_signal(&score_queue_ready);
+    pthread_mutex_unlock(&score_queue_lock);
+}
+
+// Score writer thread: the stats log, the leaderboard and its file for
+// every finished server game, one at a time
+void* score_writer_main(void* unused) {
+    (void)unused;
+
+    while (1) {
+        pthread_mutex_lock(&score_queue_lock);
+        while (score_queue_count == 0) {
+            pthread_cond_wait(&score_queue_ready, &score_queue_lock);
+        }
+        FinishedGame finished = score_queue[score_queue_head];
+        score_queue_head = (score_queue_head + 1) % SCORE_QUEUE_SIZE;
+        score_queue_count--;
+        pthread_mutex_unlock(&score_queue_lock);
+
+        record_game_stats(&finished);
+
+        // Wait out the first load without holding the lock workers draw under
+        pthread_mutex_lock(&leaderboard_lock);
+        while (!high_scores_ready()) {
+            pthread_mutex_unlock(&leaderboard_lock);
+            usleep(10000);
+            pthread_mutex_lock(&leaderboard_lock);
+        }
+
+        shared_board_sync();
+        ScoreNode* existing = find_player_entry(finished.name);
+        int posted = existing != NULL ? finished.score > existing->score : is_high_score(finished.score);
+        if (posted) {
+            add_high_score(finished.name, finished.score);
+        }
+        pthread_mutex_unlock(&leaderboard_lock);
+
+        // Only this thread changes the list in the server, so it can be
+        // read for saving without making the workers wait on the disk
+        if (posted) {
+            save_high_scores();
+        }
+    }
+    return NULL;
+}
+
+// Serve independent games to telnet clients on a local port until killed
+int run_server(int port) {
+    server_mode = 1;
+    quiet_mode = 1;         // no messages or pauses from the shared game code
+    practice_mode = 0;      // rewind history would cost every session 50 snapshots
+    terminal_resized = 0;   // sessions keep the classic view size
+
+    // Fill the move delay table before the workers race to do it
+    draw_move_delay();
+
+    // Thousands of sessions need thousands of descriptors
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    server_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_listen_fd < 0) {
+        return 1;
+    }
+    int on = 1;
+    setsockopt(server_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server_listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server_listen_fd, SOMAXCONN) != 0) {
+        printf("Could not listen on port %d: %s\n", port, strerror(errno));
+        close(server_listen_fd);
+        return 1;
+    }
+    fcntl(server_listen_fd, F_SETFL, fcntl(server_listen_fd, F_GETFL) | O_NONBLOCK);
+
+    if (pthread_create(&score_writer, NULL, score_writer_main, NULL) != 0) {
+        printf("Could not start the score writer\n");
+        return 1;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    server_worker_count = cores < 1 ? 1 : cores > SERVER_MAX_WORKERS ? SERVER_MAX_WORKERS : (int)cores;
+    for (int i = 0; i < server_worker_count; i++) {
+        ServerWorker* worker = &server_workers[i];
+        worker->epoll_fd = epoll_create1(0);
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.ptr = NULL;
+        if (worker->epoll_fd < 0 || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, server_listen_fd, &event) != 0 ||
+            pthread_create(&worker->thread, NULL, server_worker_main, worker) != 0) {
+            printf("Could not start server worker %d\n", i);
+            return 1;
+        }
+    }
+
+    printf("Serving games on 127.0.0.1:%d with %d workers (telnet 127.0.0.1 %d)\n",
+           port, server_worker_count, port);
+    printf("Each session uses %zu bytes plus its unsent output (at most %d bytes)\n",
+           sizeof(Session), SESSION_OUTPUT_LIMIT);
+    fflush(stdout);
+
+    // The main thread only reports
+    while (1) {
+        sleep(SERVER_STATUS_SECONDS);
+        int sessions = atomic_load_explicit(&server_sessions, memory_order_relaxed);
+        long output_bytes = atomic_load_explicit(&server_output_bytes, memory_order_relaxed);
+        long total = (long)sessions * (long)sizeof(Session) + output_bytes;
+        printf("%d sessions, %ld KB session memory (%ld bytes each, %ld KB output buffers), %lu frames skipped, %lu scores dropped\n",
+               sessions, total / 1024, sessions > 0 ? total / sessions : 0L, output_bytes / 1024,
+               atomic_load_explicit(&server_frames_dropped, memory_order_relaxed),
+               atomic_load_explicit(&score_queue_dropped, memory_order_relaxed));
+        fflush(stdout);
+    }
+    return 0;
+}
+
+// Library interface (tankgame.h). Each call swaps the batch's games
+// through the thread's game state one at a time and runs the same
+// update_game() as the terminal game.
+
+// Mode flags for a batch; they are process-wide like the command line
+// ones, which is why tank_batch_create() refuses mixed options
+static void tank_batch_apply_options(const TankBatch* batch) {
+    large_map_mode = (batch->options & TANK_LARGE_MAP) != 0;
+    bitboard_mode = (batch->options & TANK_BITBOARD) != 0;
+    ai_mode = (batch->options & TANK_AI) != 0;
+    quiet_mode = 1;
+    particles_enabled = 0;
+}
+
+// Write the current game into one observation slot
+static void tank_write_observation(unsigned char* slot) {
+    TankObservation* header = (TankObservation*)slot;
+    header->width = game.world_width;
+    header->height = game.world_height;
+    header->player_x = game.player_x;
+    header->player_y = game.player_y;
+    header->lives = game.player_lives;
+    header->score = game.score;
+    header->ticks = game.ticks;
+    header->reserved = 0;
+
+    int w = game.world_width, h = game.world_height;
+    unsigned char* cells = slot + sizeof(TankObservation);
+    memset(cells, TANK_CELL_WALL, w);
+    for (int y = 1; y < h - 1; y++) {
+        unsigned char* row = cells + y * w;
+        row[0] = TANK_CELL_WALL;
+        memset(row + 1, TANK_CELL_EMPTY, w - 2);
+        row[w - 1] = TANK_CELL_WALL;
+    }
+    memset(cells + (h - 1) * w, TANK_CELL_WALL, w);
+
+    // Same layering as render_game(): enemies over bullets, player underneath
+    cells[game.player_y * w + game.player_x] = TANK_CELL_PLAYER;
+    for (int i = 0; i < MAX_BULLETS; i++) {
+        if (game.bullets[i].active) {
+            cells[game.bullets[i].y * w + game.bullets[i].x] = TANK_CELL_BULLET;
+        }
+    }
+    for (int i = 0; i < game.enemy_limit; i++) {
+        if (game.enemies[i].active) {
+            cells[game.enemies[i].y * w + game.enemies[i].x] = TANK_CELL_ENEMY;
+        }
+    }
+}
+
+// Start game i over with the batch's next seed
+static void tank_batch_new_game(TankBatch* batch, int i) {
+    batch->rng ^= batch->rng << 13;
+    batch->rng ^= batch->rng >> 17;
+    batch->rng ^= batch->rng << 5;
+    initialize_game_with_seed(batch->rng);
+    memcpy(&batch->games[i], &game, sizeof(GameState));
+    batch->ended[i] = 0;
+}
+
+TankBatch* tank_batch_create(int count, unsigned int seed, int options) {
+    if (count <= 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&tank_batches_lock);
+    if (tank_batches_live > 0 && tank_batches_options != options) {
+        pthread_mutex_unlock(&tank_batches_lock);
+        return NULL;
+    }
+    tank_batches_live++;
+    tank_batches_options = options;
+    pthread_mutex_unlock(&tank_batches_lock);
+
+    TankBatch* batch = (TankBatch*)calloc(1, sizeof(TankBatch));
+    if (batch == NULL) {
+        pthread_mutex_lock(&tank_batches_lock);
+        tank_batches_live--;
+        pthread_mutex_unlock(&tank_batches_lock);
+        return NULL;
+    }
+    batch->count = count;
+    batch->options = options;
+    batch->rng = seed ? seed : 1;  // xorshift must not start at zero
+
+    size_t cells = (options & TANK_LARGE_MAP) ? (size_t)WORLD_WIDTH * WORLD_HEIGHT : (size_t)WIDTH * HEIGHT;
+    batch->observation_size = (sizeof(TankObservation) + cells + 15) & ~(size_t)15;
+
+    batch->games = (GameState*)malloc((size_t)count * sizeof(GameState));
+    batch->ended = (unsigned char*)malloc(count);
+    if (batch->games == NULL || batch->ended == NULL) {
+        tank_batch_destroy(batch);
+        return NULL;
+    }
+
+    tank_batch_apply_options(batch);
+    for (int i = 0; i < count; i++) {
+        tank_batch_new_game(batch, i);
+    }
+    return batch;
+}
+
+void tank_batch_destroy(TankBatch* batch) {
+    if (batch == NULL) return;
+    free(batch->games);
+    free(batch->ended);
+    free(batch);
+
+    pthread_mutex_lock(&tank_batches_lock);
+    tank_batches_live--;
+    pthread_mutex_unlock(&tank_batches_lock);
+}
+
+size_t tank_observation_size(const TankBatch* batch) {
+    return batch->observation_size;
+}
+
+int tank_batch_reset(TankBatch* batch, int index, unsigned char* observations) {
+    if (index < -1 || index >= batch->count) {
+        return -1;
+    }
+
+    tank_batch_apply_options(batch);
+    int first = index < 0 ? 0 : index;
+    int last = index < 0 ? batch->count - 1 : index;
+    for (int i = first; i <= last; i++) {
+        tank_batch_new_game(batch, i);
+        if (observations != NULL) {
+            tank_write_observation(observations + (size_t)i * batch->observation_size);
+        }
+    }
+    return 0;
+}
+
+void tank_batch_step(TankBatch* batch, const unsigned char* actions,
+                     unsigned char* observations, float* rewards, unsigned char* dones) {
+    tank_batch_apply_options(batch);
+
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->ended[i]) {
+            tank_batch_new_game(batch, i);
+        } else {
+            restore_game_state(&batch->games[i]);
+        }
+
+        int score = game.score;
+        int lives = game.player_lives;
+
+        // Same keys as play_game()
+        switch (actions[i]) {
+            case TANK_LEFT:  move_player('a'); break;
+            case TANK_RIGHT: move_player('d'); break;
+            case TANK_FIRE:  fire_bullet(); break;
+            case TANK_UP:    if (large_map_mode) move_player('w'); break;
+            case TANK_DOWN:  if (large_map_mode) move_player('x'); break;
+        }
+        update_game();
+
+        batch->ended[i] = game.player_lives <= 0;
+        if (rewards != NULL) {
+            rewards[i] = (float)((game.score - score) - (lives - game.player_lives));
+        }
+        if (dones != NULL) {
+            dones[i] = batch->ended[i];
+        }
+        if (observations != NULL) {
+            tank_write_observation(observations + (size_t)i * batch->observation_size);
+        }
+        memcpy(&batch->games[i], &game, sizeof(GameState));
+    }
+}
+
+// Main function (left out when building libtankgame)
+#ifndef TANKGAME_LIBRARY
+static void print_usage(const char* program) {
+    printf("Usage: %s [--practice] [--ai] [--large-map] [--bitboard] [--shared-scores] [--record FILE] [--metrics PORT|unix:PATH] [--broadcast | --spectate] [--serve PORT]\n", program);
+    printf("       %s stats [--player NAME] [--days N]\n", program);
+    printf("       %s fuzz [game|leaderboard|collisions] [--seed N] [--runs N] [--steps N] [--skip CHECK]\n", program);
+    printf("       %s bench [--iterations N]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    process_start_us = now_us();
+    int use_shared_board = 0;
+    int serve_port = 0;
+
+    // Subcommands
+    if (argc > 1 && strcmp(argv[1], "stats") == 0) {
+        return run_stats(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "fuzz") == 0) {
+        return run_fuzz(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return run_bench(argc - 2, argv + 2);
+    }
+
+    // Command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--spectate") == 0) {
+            return run_spectator();
+        } else if (strcmp(argv[i], "--practice") == 0) {
+            practice_mode = 1;
+        } else if (strcmp(argv[i], "--ai") == 0) {
+            ai_mode = 1;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            const char* path = argv[++i];
+            if (start_recording(path)) {
+                atexit(stop_recording);
+            } else {
+                printf("Could not record to %s, continuing without it.\n", path);
+            }
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            const char* address = argv[++i];
+            if (!start_metrics(address)) {
+                printf("Could not serve metrics on %s, continuing without it.\n", address);
+            }
+        } else if (strcmp(argv[i], "--large-map") == 0) {
+            large_map_mode = 1;
+        } else if (strcmp(argv[i], "--bitboard") == 0) {
+            bitboard_mode = 1;
+        } else if (strcmp(argv[i], "--shared-scores") == 0) {
+            use_shared_board = 1;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_port = parse_port(argv[++i]);
+            if (serve_port == 0) {
+                printf("Invalid port: %s (expected 1-65535)\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--broadcast") == 0) {
+            if (open_broadcast()) {
+                atexit(close_broadcast);
+            } else if (errno == EWOULDBLOCK) {
+                printf("Another game is already broadcasting, continuing without it.\n");
+            } else {
+                printf("Could not start broadcast, continuing without it.\n");
+            }
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Initialize random number generator
+    srand(time(NULL));
+
+    // An existing shared leaderboard replaces the text file entirely
+    if (use_shared_board && !open_shared_board()) {
+        printf("Could not open %s, using %s instead.\n", SHARED_SCORE_FILE, HIGH_SCORE_FILE);
+    }
+
+    // Load high scores (with a shared board, just the player names) while
+    // the menu is already up
+    start_loading_high_scores();
+
+    // Host games for telnet clients instead of playing here
+    if (serve_port > 0) {
+        return run_server(serve_port);
+    }
+
+    // Set up the terminal
+    setup_terminal();
+    signal(SIGWINCH, handle_resize);
+
+    // Start the game
+    show_welcome();
+
+    // Clean up
+    reset_terminal();
+    clear_screen();
+    printf("\nThanks for playing!\n\n");
+
+    // Free memory used by high score linked list
+    wait_for_high_scores();
+    free_score_list();
+
+    return 0;
+}
+#endif
@@ -0,0 +1,85 @@
+// tankgame.h - C interface to the Tank Battleship rules, for analysis
+// tools and experiments that want to drive many games without a terminal.
+//
+// Build the library from the game source:
+//     gcc -O2 -shared -fPIC -fvisibility=hidden -DTANKGAME_LIBRARY main.c -o libtankgame.so
+//
+// A batch holds N independent games that step together. Observations
+// are written straight into one caller-owned buffer, N slots of
+// tank_observation_size() bytes each; nothing is allocated after
+// tank_batch_create(). A batch must only be used by one thread at a time,
+// and batches that exist at the same time must share the same options.
+#ifndef TANKGAME_H
+#define TANKGAME_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TANKGAME_API __attribute__((visibility("default")))
+
+// Actions, one byte per game per step
+enum {
+    TANK_IDLE,
+    TANK_LEFT,
+    TANK_RIGHT,
+    TANK_FIRE,
+    TANK_UP,    // large map only
+    TANK_DOWN   // large map only
+};
+
+// Batch options
+#define TANK_LARGE_MAP 1  // 240x120 world with 96 enemies
+#define TANK_BITBOARD 2   // bitboard collisions on the classic board
+#define TANK_AI 4         // enemies steer toward the player
+
+// Board cells in an observation
+enum {
+    TANK_CELL_EMPTY,
+    TANK_CELL_WALL,
+    TANK_CELL_PLAYER,
+    TANK_CELL_ENEMY,
+    TANK_CELL_BULLET
+};
+
+// Start of every observation slot. width * height cells follow, one byte
+// each, row by row from the top.
+typedef struct {
+    int width, height;
+    int player_x, player_y;
+    int lives;
+    int score;
+    int ticks;
+    int reserved;
+} TankObservation;
+
+typedef struct TankBatch TankBatch;
+
+// Create count games seeded from seed. Returns NULL on bad arguments, if
+// memory runs out, or if a batch with different options still exists.
+TANKGAME_API TankBatch* tank_batch_create(int count, unsigned int seed, int options);
+
+TANKGAME_API void tank_batch_destroy(TankBatch* batch);
+
+// Bytes per observation slot (a multiple of 16)
+TANKGAME_API size_t tank_observation_size(const TankBatch* batch);
+
+// Start new games: one game, or every game when index is -1. Their
+// observations are written if observations is not NULL. Returns 0, or -1
+// for a bad index.
+TANKGAME_API int tank_batch_reset(TankBatch* batch, int index, unsigned char* observations);
+
+// Apply one action to every game and advance each by one tick.
+// rewards[i] is +1 per enemy destroyed and -1 per life lost this tick;
+// dones[i] is 1 when game i has just ended. An ended game starts over
+// on its next step. rewards and dones may be NULL.
+TANKGAME_API void tank_batch_step(TankBatch* batch, const unsigned char* actions,
+                                  unsigned char* observations, float* rewards, unsigned char* dones);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif